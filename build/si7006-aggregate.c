@@ -0,0 +1,242 @@
+/*
+ * si7006-aggregate.c - Part of OPEN-EYES-II products, Linux kernel modules for
+ * hardware monitoring
+ * Aggregate of all the sensors bound to the Si7006 driver.
+ * Author:
+ * Massimiliano Negretti <massimiliano.negretti@open-eyes.it> 2020-07-12
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+
+#include <linux/module.h>
+#include <linux/i2c.h>
+#include <linux/hwmon.h>
+#include <linux/list.h>
+#include <linux/math64.h>
+#include <linux/mutex.h>
+#include <linux/platform_device.h>
+#include <linux/seqlock.h>
+#include "si7006.h"
+
+static bool aggregate;
+module_param(aggregate, bool, 0444);
+MODULE_PARM_DESC(aggregate,
+	"Register a hwmon device with min/mean/max of all the sensors");
+
+/* Bound sensors */
+static LIST_HEAD(si7006_instances);
+static DEFINE_MUTEX(si7006_instances_lock);
+
+static struct platform_device *si7006_aggregate_pdev;
+static struct device *si7006_aggregate_hwmon;
+
+/**
+ * @brief Aggregate a value of the cached samples of all the sensors
+ * @param [in] offset offset of the value inside struct si7006_sample
+ * @param [in] channel SI7006_AGG_MIN, SI7006_AGG_MEAN or SI7006_AGG_MAX
+ * @param [out] val aggregated value
+ * @return 0 if success, -ENODATA when no sensor has a valid sample
+ * @details Only the cached samples are used, the sensors are never
+ * addressed. Sensors without a sample or in fault are skipped.
+ */
+static int si7006_aggregate_value(size_t offset, int channel, long *val)
+{
+	struct si7006_private *data;
+	long lowest = LONG_MAX, highest = LONG_MIN;
+	long long sum = 0;
+	unsigned int seq;
+	unsigned int count = 0;
+	bool valid;
+	long v;
+
+	mutex_lock(&si7006_instances_lock);
+	list_for_each_entry(data, &si7006_instances, node) {
+		do {
+			seq = read_seqbegin(&data->sample_lock);
+			valid = data->sample_valid && !READ_ONCE(data->fault);
+			v = *(long *)((char *)&data->sample + offset);
+		} while (read_seqretry(&data->sample_lock, seq));
+
+		if (!valid)
+			continue;
+
+		lowest = min(lowest, v);
+		highest = max(highest, v);
+		sum += v;
+		count++;
+	}
+	mutex_unlock(&si7006_instances_lock);
+
+	if (!count)
+		return -ENODATA;
+
+	switch (channel) {
+		case SI7006_AGG_MIN:
+			*val = lowest;
+			break;
+		case SI7006_AGG_MAX:
+			*val = highest;
+			break;
+		default:
+			*val = div_s64(sum, count);
+			break;
+	}
+
+	return 0;
+}
+
+static int si7006_aggregate_read(struct device *dev,
+			enum hwmon_sensor_types type, u32 attr, int channel,
+			long *val)
+{
+	switch (type) {
+		case hwmon_temp:
+			return si7006_aggregate_value(offsetof(struct si7006_sample,
+						temperature), channel, val);
+		case hwmon_humidity:
+			return si7006_aggregate_value(offsetof(struct si7006_sample,
+						humidity), channel, val);
+		default:
+			return -EOPNOTSUPP;
+	}
+}
+
+static const char * const si7006_aggregate_labels[] = {
+	[SI7006_AGG_MIN] = "min",
+	[SI7006_AGG_MEAN] = "mean",
+	[SI7006_AGG_MAX] = "max",
+};
+
+static int si7006_aggregate_read_string(struct device *dev,
+			enum hwmon_sensor_types type, u32 attr, int channel,
+			const char **str)
+{
+	*str = si7006_aggregate_labels[channel];
+
+	return 0;
+}
+
+static umode_t si7006_aggregate_is_visible(const void *data,
+			enum hwmon_sensor_types type, u32 attr, int channel)
+{
+	return S_IRUGO;
+}
+
+static const u32 si7006_aggregate_temperature_config[] = {
+	(HWMON_T_INPUT|HWMON_T_LABEL),
+	(HWMON_T_INPUT|HWMON_T_LABEL),
+	(HWMON_T_INPUT|HWMON_T_LABEL),
+	0
+};
+
+static const struct hwmon_channel_info si7006_aggregate_temperature = {
+	.type = hwmon_temp,
+	.config = si7006_aggregate_temperature_config,
+};
+
+static const u32 si7006_aggregate_humidity_config[] = {
+	(HWMON_H_INPUT|HWMON_H_LABEL),
+	(HWMON_H_INPUT|HWMON_H_LABEL),
+	(HWMON_H_INPUT|HWMON_H_LABEL),
+	0
+};
+
+static const struct hwmon_channel_info si7006_aggregate_humidity = {
+	.type = hwmon_humidity,
+	.config = si7006_aggregate_humidity_config,
+};
+
+static const struct hwmon_channel_info *si7006_aggregate_info[] = {
+	&si7006_aggregate_temperature,
+	&si7006_aggregate_humidity,
+	NULL
+};
+
+static const struct hwmon_ops si7006_aggregate_ops = {
+	.is_visible = si7006_aggregate_is_visible,
+	.read_string = si7006_aggregate_read_string,
+	.read = si7006_aggregate_read,
+};
+
+static const struct hwmon_chip_info si7006_aggregate_chip_info = {
+	.ops = &si7006_aggregate_ops,
+	.info = si7006_aggregate_info,
+};
+
+/**
+ * @brief Remove a sensor from the aggregate
+ * @param [in] arg struct si7006_private pointer
+ * @details Registered as devm action.
+ */
+static void si7006_aggregate_remove(void *arg)
+{
+	struct si7006_private *data = arg;
+
+	mutex_lock(&si7006_instances_lock);
+	list_del(&data->node);
+	mutex_unlock(&si7006_instances_lock);
+}
+
+/**
+ * @brief Add a sensor to the aggregate
+ * @param [in] data struct si7006_private pointer
+ * @return 0 if success
+ */
+int si7006_aggregate_add(struct si7006_private *data)
+{
+	mutex_lock(&si7006_instances_lock);
+	list_add_tail(&data->node, &si7006_instances);
+	mutex_unlock(&si7006_instances_lock);
+
+	return devm_add_action_or_reset(&data->client->dev,
+				si7006_aggregate_remove, data);
+}
+
+/**
+ * @brief Register the aggregate hwmon device
+ * @return 0 if success
+ * @details Only when the aggregate module parameter is set. The hwmon device
+ * hangs from a "si7006-aggregate" platform device.
+ */
+int si7006_aggregate_init(void)
+{
+	if (!aggregate)
+		return 0;
+
+	si7006_aggregate_pdev = platform_device_register_simple(
+				"si7006-aggregate", PLATFORM_DEVID_NONE, NULL, 0);
+	if (IS_ERR(si7006_aggregate_pdev))
+		return PTR_ERR(si7006_aggregate_pdev);
+
+	si7006_aggregate_hwmon = hwmon_device_register_with_info(
+				&si7006_aggregate_pdev->dev, "si7006_aggregate",
+				NULL, &si7006_aggregate_chip_info, NULL);
+	if (IS_ERR(si7006_aggregate_hwmon)) {
+		platform_device_unregister(si7006_aggregate_pdev);
+		return PTR_ERR(si7006_aggregate_hwmon);
+	}
+
+	return 0;
+}
+
+void si7006_aggregate_exit(void)
+{
+	if (!aggregate)
+		return;
+
+	hwmon_device_unregister(si7006_aggregate_hwmon);
+	platform_device_unregister(si7006_aggregate_pdev);
+}
@@ -0,0 +1,327 @@
+/*
+ * si7006-chardev.c - Part of OPEN-EYES-II products, Linux kernel modules for
+ * hardware monitoring
+ * Character device of the Si7006 driver.
+ * Author:
+ * Massimiliano Negretti <massimiliano.negretti@open-eyes.it> 2020-07-12
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <linux/module.h>
+#include <linux/i2c.h>
+#include <linux/capability.h>
+#include <linux/fs.h>
+#include <linux/kref.h>
+#include <linux/list.h>
+#include <linux/miscdevice.h>
+#include <linux/rwsem.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include "si7006.h"
+#include "si7006-uapi.h"
+
+/*
+ * The character device outlives the sensor while files are open: it is
+ * reference counted and data is cleared when the sensor goes away.
+ */
+struct si7006_cdev {
+	struct miscdevice              misc;
+	struct kref                    kref;
+	/* Protects data and files */
+	struct mutex                   lock;
+	/* Pins data for the sample reads, which don't take lock */
+	struct rw_semaphore            data_sem;
+	struct si7006_private          *data;
+	struct list_head               files;
+	struct si7006_shared_page      *page;
+	char                           name[32];
+};
+
+/* Open file, with its freshness contract */
+struct si7006_file {
+	struct si7006_cdev             *cdev;
+	struct list_head               node;
+	unsigned int                   max_age;
+};
+
+static void si7006_cdev_free(struct kref *kref)
+{
+	struct si7006_cdev *cdev = container_of(kref, struct si7006_cdev, kref);
+
+	/* Pages still mapped hold their own reference */
+	free_page((unsigned long)cdev->page);
+	kfree(cdev);
+}
+
+/**
+ * @brief Update the shared sample page
+ * @param [in] data struct si7006_private pointer
+ * @details Must be called with update_lock held, every time the sample or
+ * its status changes.
+ */
+void si7006_chardev_update(struct si7006_private *data)
+{
+	struct si7006_shared_page *page;
+
+	if (!data->cdev)
+		return;
+	page = data->cdev->page;
+
+	WRITE_ONCE(page->lock, page->lock + 1);
+	smp_wmb();
+
+	page->flags = si7006_status_flags(data);
+	page->seq = data->sample.seq;
+	page->timestamp_ns = ktime_to_ns(data->sample.timestamp);
+	page->temperature = data->sample.temperature;
+	page->humidity = data->sample.humidity;
+	page->min_temperature = data->min_temperature;
+	page->max_temperature = data->max_temperature;
+	page->min_humidity = data->min_humidity;
+	page->max_humidity = data->max_humidity;
+	page->dew_point = data->sample.dew_point;
+
+	smp_wmb();
+	WRITE_ONCE(page->lock, page->lock + 1);
+}
+
+/**
+ * @brief Apply the strictest contract of the open files
+ * @param [in] cdev struct si7006_cdev pointer
+ * @details Must be called with cdev->lock held.
+ */
+static void si7006_cdev_contract(struct si7006_cdev *cdev)
+{
+	struct si7006_file *f;
+	unsigned int max_age = 0;
+
+	if (!cdev->data)
+		return;
+
+	list_for_each_entry(f, &cdev->files, node)
+		if (f->max_age && (!max_age || f->max_age < max_age))
+			max_age = f->max_age;
+
+	si7006_set_contract(cdev->data, max_age);
+}
+
+static int si7006_cdev_open(struct inode *inode, struct file *file)
+{
+	struct si7006_cdev *cdev = container_of(file->private_data,
+					struct si7006_cdev, misc);
+	struct si7006_file *f;
+
+	f = kzalloc(sizeof(*f), GFP_KERNEL);
+	if (!f)
+		return -ENOMEM;
+
+	kref_get(&cdev->kref);
+	f->cdev = cdev;
+
+	mutex_lock(&cdev->lock);
+	list_add(&f->node, &cdev->files);
+	mutex_unlock(&cdev->lock);
+
+	file->private_data = f;
+
+	return nonseekable_open(inode, file);
+}
+
+static int si7006_cdev_release(struct inode *inode, struct file *file)
+{
+	struct si7006_file *f = file->private_data;
+	struct si7006_cdev *cdev = f->cdev;
+
+	mutex_lock(&cdev->lock);
+	list_del(&f->node);
+	if (f->max_age)
+		si7006_cdev_contract(cdev);
+	mutex_unlock(&cdev->lock);
+
+	kfree(f);
+	kref_put(&cdev->kref, si7006_cdev_free);
+
+	return 0;
+}
+
+/**
+ * @brief Character device ioctl method
+ * @details Each open file has its own freshness contract: the max age in
+ * milliseconds of the samples it reads with SI7006_IOC_READ_SAMPLE. The
+ * background sampler follows the strictest contract of all the open files.
+ * Setting a contract needs a file open for writing or CAP_SYS_ADMIN, and the
+ * contract can't be shorter than the min sampler interval.
+ */
+static long si7006_cdev_ioctl(struct file *file, unsigned int cmd,
+			unsigned long arg)
+{
+	struct si7006_file *f = file->private_data;
+	struct si7006_cdev *cdev = f->cdev;
+	u32 __user *age_arg = (u32 __user *)arg;
+	struct si7006_ioc_sample out;
+	struct si7006_sample sample;
+	u32 max_age;
+	u32 flags;
+	int ret;
+
+	switch (cmd) {
+		case SI7006_IOC_SET_MAX_AGE:
+			/* A contract drives the sampler, i.e. the shared bus */
+			if (!(file->f_mode & FMODE_WRITE) &&
+					!capable(CAP_SYS_ADMIN))
+				return -EPERM;
+			if (get_user(max_age, age_arg))
+				return -EFAULT;
+			if (max_age && (max_age < SI7006_MIN_SAMPLE_INTERVAL_MS ||
+					max_age > SI7006_MAX_UPDATE_INTERVAL_MS))
+				return -EINVAL;
+			mutex_lock(&cdev->lock);
+			WRITE_ONCE(f->max_age, max_age);
+			si7006_cdev_contract(cdev);
+			mutex_unlock(&cdev->lock);
+			return 0;
+		case SI7006_IOC_GET_MAX_AGE:
+			return put_user(f->max_age, age_arg);
+		case SI7006_IOC_READ_SAMPLE:
+			/* Not under lock: the read may wait for a conversion */
+			ret = down_read_killable(&cdev->data_sem);
+			if (ret)
+				return ret;
+			if (cdev->data)
+				ret = si7006_read_fresh(cdev->data,
+						READ_ONCE(f->max_age), &sample,
+						&flags);
+			else
+				ret = -ENODEV;
+			up_read(&cdev->data_sem);
+			if (ret < 0)
+				return ret;
+
+			memset(&out, 0, sizeof(out));
+			out.seq = sample.seq;
+			out.timestamp_ns = ktime_to_ns(sample.timestamp);
+			out.temperature = sample.temperature;
+			out.humidity = sample.humidity;
+			out.dew_point = sample.dew_point;
+			out.flags = flags;
+			if (copy_to_user((void __user *)arg, &out, sizeof(out)))
+				return -EFAULT;
+			return 0;
+		default:
+			return -ENOTTY;
+	}
+}
+
+/**
+ * @brief Map the sample page
+ * @details Only a read-only shared mapping of the first page is allowed.
+ */
+static int si7006_cdev_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct si7006_file *f = file->private_data;
+	struct si7006_cdev *cdev = f->cdev;
+
+	if (vma->vm_pgoff || vma->vm_end - vma->vm_start != PAGE_SIZE)
+		return -EINVAL;
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+
+	vma->vm_flags &= ~VM_MAYWRITE;
+	vma->vm_flags |= VM_DONTEXPAND | VM_DONTDUMP;
+
+	return vm_insert_page(vma, vma->vm_start, virt_to_page(cdev->page));
+}
+
+static const struct file_operations si7006_cdev_fops = {
+	.owner = THIS_MODULE,
+	.open = si7006_cdev_open,
+	.release = si7006_cdev_release,
+	.mmap = si7006_cdev_mmap,
+	.unlocked_ioctl = si7006_cdev_ioctl,
+	.compat_ioctl = compat_ptr_ioctl,
+	.llseek = no_llseek,
+};
+
+/**
+ * @brief Unregister the character device
+ * @param [in] arg struct si7006_private pointer
+ * @details Registered as devm action. Open files keep the device alive, but
+ * it no longer refers to the sensor.
+ */
+static void si7006_chardev_unregister(void *arg)
+{
+	struct si7006_private *data = arg;
+	struct si7006_cdev *cdev = data->cdev;
+
+	misc_deregister(&cdev->misc);
+
+	mutex_lock(&cdev->lock);
+	down_write(&cdev->data_sem);
+	mutex_lock(&data->update_lock);
+	data->cdev = NULL;
+	cdev->data = NULL;
+	mutex_unlock(&data->update_lock);
+	up_write(&cdev->data_sem);
+	mutex_unlock(&cdev->lock);
+
+	kref_put(&cdev->kref, si7006_cdev_free);
+}
+
+/**
+ * @brief Register the character device of a sensor
+ * @param [in] data struct si7006_private pointer
+ * @return 0 if success
+ * @details Creates /dev/si7006-<bus>-<addr>.
+ */
+int si7006_chardev_register(struct si7006_private *data)
+{
+	struct device *dev = &data->client->dev;
+	struct si7006_cdev *cdev;
+	int ret;
+
+	cdev = kzalloc(sizeof(*cdev), GFP_KERNEL);
+	if (!cdev)
+		return -ENOMEM;
+
+	cdev->page = (struct si7006_shared_page *)get_zeroed_page(GFP_KERNEL);
+	if (!cdev->page) {
+		kfree(cdev);
+		return -ENOMEM;
+	}
+
+	kref_init(&cdev->kref);
+	mutex_init(&cdev->lock);
+	init_rwsem(&cdev->data_sem);
+	INIT_LIST_HEAD(&cdev->files);
+	cdev->data = data;
+	snprintf(cdev->name, sizeof(cdev->name), "si7006-%s", dev_name(dev));
+	cdev->misc.minor = MISC_DYNAMIC_MINOR;
+	cdev->misc.name = cdev->name;
+	cdev->misc.fops = &si7006_cdev_fops;
+	cdev->misc.parent = dev;
+	cdev->misc.mode = 0444;
+
+	ret = misc_register(&cdev->misc);
+	if (ret) {
+		kref_put(&cdev->kref, si7006_cdev_free);
+		return ret;
+	}
+
+	data->cdev = cdev;
+
+	return devm_add_action_or_reset(dev, si7006_chardev_unregister, data);
+}
@@ -0,0 +1,688 @@
+/*
+ * si7006-debugfs.c - Part of OPEN-EYES-II products, Linux kernel modules for
+ * hardware monitoring
+ * Debug interface of the Si7006 driver.
+ * Author:
+ * Massimiliano Negretti <massimiliano.negretti@open-eyes.it> 2020-07-12
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <linux/module.h>
+#include <linux/i2c.h>
+#include <linux/debugfs.h>
+#include <linux/delay.h>
+#include <linux/fault-inject.h>
+#include <linux/random.h>
+#include <linux/relay.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+#include "si7006.h"
+#include "si7006-uapi.h"
+
+static struct dentry *si7006_debugfs_root;
+
+/****************************************************************************
+ * FAULT INJECTION
+ ****************************************************************************/
+
+#ifdef CONFIG_FAULT_INJECTION
+
+/*
+ * One fault_attr per kind of failure, each configured through its own
+ * debugfs directory (probability, interval, times, ...).
+ */
+struct si7006_faults {
+	struct fault_attr              eio;
+	struct fault_attr              timeout;
+	struct fault_attr              nack;
+	struct fault_attr              corrupt;
+	struct fault_attr              stretch;
+	u32                            stretch_us;
+};
+
+static DECLARE_FAULT_ATTR(si7006_fault_default);
+
+/**
+ * @brief Inject a failure in an I2C message
+ * @param [in] data struct si7006_private pointer
+ * @return error to return instead of running the message, 0 if none
+ * @details Called before every message. A stretch fault delays the message
+ * like a sensor holding the clock low, then lets it run.
+ */
+int si7006_fault_inject(struct si7006_private *data)
+{
+	struct si7006_faults *faults = data->faults;
+
+	if (!faults)
+		return 0;
+
+	if (should_fail(&faults->stretch, 1))
+		usleep_range(faults->stretch_us, faults->stretch_us + 100);
+	if (should_fail(&faults->eio, 1))
+		return -EIO;
+	if (should_fail(&faults->timeout, 1))
+		return -ETIMEDOUT;
+	/* Adapters report an address NACK as ENXIO */
+	if (should_fail(&faults->nack, 1))
+		return -ENXIO;
+
+	return 0;
+}
+
+/**
+ * @brief Corrupt the result of a read message
+ * @param [in] data struct si7006_private pointer
+ * @param [in,out] buf received bytes
+ * @param [in] len number of received bytes
+ * @details Flips one random bit of the result.
+ */
+void si7006_fault_corrupt(struct si7006_private *data, u8 *buf, int len)
+{
+	struct si7006_faults *faults = data->faults;
+	u32 bit;
+
+	if (!faults || !len || !should_fail(&faults->corrupt, 1))
+		return;
+
+	bit = prandom_u32_max(len * 8);
+	buf[bit / 8] ^= BIT(bit % 8);
+}
+
+/**
+ * @brief Create the fault injection attributes of a sensor
+ * @param [in] data struct si7006_private pointer
+ * @param [in] dir debugfs directory of the sensor
+ */
+static void si7006_fault_register(struct si7006_private *data,
+			struct dentry *dir)
+{
+	struct device *dev = &data->client->dev;
+	struct si7006_faults *faults;
+
+	faults = devm_kzalloc(dev, sizeof(*faults), GFP_KERNEL);
+	if (!faults)
+		return;
+
+	faults->eio = si7006_fault_default;
+	faults->timeout = si7006_fault_default;
+	faults->nack = si7006_fault_default;
+	faults->corrupt = si7006_fault_default;
+	faults->stretch = si7006_fault_default;
+	faults->stretch_us = 10000;
+
+	/* Without CONFIG_FAULT_INJECTION_DEBUG_FS nothing can be enabled */
+	if (IS_ERR(fault_create_debugfs_attr("fail_eio", dir, &faults->eio)))
+		return;
+	fault_create_debugfs_attr("fail_timeout", dir, &faults->timeout);
+	fault_create_debugfs_attr("fail_nack", dir, &faults->nack);
+	fault_create_debugfs_attr("fail_corrupt", dir, &faults->corrupt);
+	fault_create_debugfs_attr("fail_stretch", dir, &faults->stretch);
+	debugfs_create_u32("stretch_us", 0600, dir, &faults->stretch_us);
+
+	data->faults = faults;
+}
+
+#else
+
+int si7006_fault_inject(struct si7006_private *data)
+{
+	return 0;
+}
+
+void si7006_fault_corrupt(struct si7006_private *data, u8 *buf, int len)
+{
+}
+
+static void si7006_fault_register(struct si7006_private *data,
+			struct dentry *dir)
+{
+}
+
+#endif /* CONFIG_FAULT_INJECTION */
+
+/****************************************************************************
+ * BUS TRACE
+ ****************************************************************************/
+
+/*
+ * The trace buffer holds a struct si7006_trace_header followed by the
+ * records, exactly as read from and written to the trace file. Its state is
+ * protected by update_lock, like every transfer.
+ */
+struct si7006_trace {
+	struct si7006_trace_header     *header;
+	struct si7006_trace_record     *records;
+	size_t                         loaded;         /* bytes written */
+	unsigned int                   pos;            /* replay position */
+	bool                           recording;
+	bool                           replaying;
+	ktime_t                        start;
+	u32                            dropped;
+	u32                            mismatches;
+};
+
+#define SI7006_TRACE_SIZE       (sizeof(struct si7006_trace_header) + \
+		SI7006_TRACE_RECORDS * sizeof(struct si7006_trace_record))
+
+/**
+ * @brief Allocate the trace buffer on first use
+ * @param [in] trace struct si7006_trace pointer
+ * @return 0 if success
+ */
+static int si7006_trace_alloc(struct si7006_trace *trace)
+{
+	if (trace->header)
+		return 0;
+
+	trace->header = vzalloc(SI7006_TRACE_SIZE);
+	if (!trace->header)
+		return -ENOMEM;
+	trace->records = (struct si7006_trace_record *)(trace->header + 1);
+
+	return 0;
+}
+
+/**
+ * @brief Check whether the transfers are served by a replayed trace
+ * @param [in] data struct si7006_private pointer
+ * @return true while replaying
+ */
+bool si7006_trace_replaying(struct si7006_private *data)
+{
+	return data->trace && data->trace->replaying;
+}
+
+/**
+ * @brief Serve an I2C message from the replayed trace
+ * @param [in] data struct si7006_private pointer
+ * @param [in] flags I2C_M_RD to read, 0 to write
+ * @param [in,out] buf message buffer
+ * @param [in] len message length
+ * @return the recorded result of the message
+ * @details Replaces the bus: the message must match the next record, its
+ * recorded duration is slept and its recorded result or error returned.
+ * On a mismatch (EPROTO) or at the end of the trace (ENODATA) the replay
+ * stops and the following messages go to the bus again.
+ */
+int si7006_trace_replay(struct si7006_private *data, u16 flags, u8 *buf,
+			int len)
+{
+	struct si7006_trace *trace = data->trace;
+	struct si7006_trace_record *rec;
+	u8 rec_flags = (flags & I2C_M_RD) ? SI7006_TRACE_READ : 0;
+	int n = min(len, SI7006_TRACE_MAX_LEN);
+	unsigned int us;
+
+	if (trace->pos >= trace->header->count) {
+		trace->replaying = false;
+		return -ENODATA;
+	}
+
+	rec = &trace->records[trace->pos++];
+	if (rec->flags != rec_flags || rec->len != len ||
+			(!rec_flags && memcmp(rec->buf, buf, n))) {
+		trace->mismatches++;
+		trace->replaying = false;
+		return -EPROTO;
+	}
+
+	us = rec->duration_ns / NSEC_PER_USEC;
+	if (us)
+		usleep_range(us, us + 1);
+
+	if (rec->error)
+		return rec->error;
+	if (rec_flags)
+		memcpy(buf, rec->buf, n);
+
+	return 0;
+}
+
+/**
+ * @brief Record an I2C message
+ * @param [in] data struct si7006_private pointer
+ * @param [in] start time the message started
+ * @param [in] flags I2C_M_RD to read, 0 to write
+ * @param [in] buf message buffer
+ * @param [in] len message length
+ * @param [in] ret result of the message
+ */
+void si7006_trace_record(struct si7006_private *data, ktime_t start,
+			u16 flags, const u8 *buf, int len, int ret)
+{
+	struct si7006_trace *trace = data->trace;
+	struct si7006_trace_record *rec;
+	u64 duration = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	if (!trace || !trace->recording)
+		return;
+
+	if (trace->header->count >= SI7006_TRACE_RECORDS) {
+		trace->dropped++;
+		return;
+	}
+
+	rec = &trace->records[trace->header->count++];
+	memset(rec, 0, sizeof(*rec));
+	rec->timestamp_ns = ktime_to_ns(ktime_sub(start, trace->start));
+	rec->duration_ns = min_t(u64, duration, U32_MAX);
+	rec->error = ret;
+	rec->flags = (flags & I2C_M_RD) ? SI7006_TRACE_READ : 0;
+	rec->len = len;
+	/* The result of a failed read is meaningless */
+	if (!(flags & I2C_M_RD) || ret == 0)
+		memcpy(rec->buf, buf, min(len, SI7006_TRACE_MAX_LEN));
+}
+
+/**
+ * @brief Read the trace
+ * @details The count of a loaded header is not trusted: the read never goes
+ * past the buffer, nor past what was loaded.
+ */
+static ssize_t si7006_trace_read(struct file *file, char __user *ubuf,
+			size_t count, loff_t *ppos)
+{
+	struct si7006_private *data = file->private_data;
+	struct si7006_trace *trace = data->trace;
+	size_t size;
+	ssize_t ret = 0;
+
+	mutex_lock(&data->update_lock);
+	if (trace->header) {
+		size = sizeof(*trace->header) +
+			min_t(u32, trace->header->count, SI7006_TRACE_RECORDS) *
+			sizeof(struct si7006_trace_record);
+		if (trace->loaded)
+			size = min(size, trace->loaded);
+		ret = simple_read_from_buffer(ubuf, count, ppos, trace->header,
+				size);
+	}
+	mutex_unlock(&data->update_lock);
+
+	return ret;
+}
+
+static ssize_t si7006_trace_write(struct file *file, const char __user *ubuf,
+			size_t count, loff_t *ppos)
+{
+	struct si7006_private *data = file->private_data;
+	struct si7006_trace *trace = data->trace;
+	ssize_t ret;
+
+	mutex_lock(&data->update_lock);
+
+	if (trace->recording || trace->replaying) {
+		ret = -EBUSY;
+		goto unlock;
+	}
+
+	ret = si7006_trace_alloc(trace);
+	if (ret)
+		goto unlock;
+
+	/* A new trace is loaded from the start of the file */
+	if (*ppos == 0)
+		trace->loaded = 0;
+
+	ret = simple_write_to_buffer(trace->header, SI7006_TRACE_SIZE, ppos,
+				ubuf, count);
+	if (ret > 0)
+		trace->loaded = max_t(size_t, trace->loaded, *ppos);
+
+unlock:
+	mutex_unlock(&data->update_lock);
+
+	return ret;
+}
+
+static const struct file_operations si7006_trace_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.read = si7006_trace_read,
+	.write = si7006_trace_write,
+	.llseek = default_llseek,
+};
+
+static int si7006_trace_record_get(void *arg, u64 *val)
+{
+	struct si7006_private *data = arg;
+
+	*val = data->trace->recording;
+
+	return 0;
+}
+
+/**
+ * @brief Start or stop recording
+ * @details Starting discards the previous trace.
+ */
+static int si7006_trace_record_set(void *arg, u64 val)
+{
+	struct si7006_private *data = arg;
+	struct si7006_trace *trace = data->trace;
+	int ret = 0;
+
+	mutex_lock(&data->update_lock);
+
+	if (!val) {
+		trace->recording = false;
+		goto unlock;
+	}
+
+	ret = si7006_trace_alloc(trace);
+	if (ret)
+		goto unlock;
+
+	trace->header->magic = SI7006_TRACE_MAGIC;
+	trace->header->version = SI7006_TRACE_VERSION;
+	trace->header->record_size = sizeof(struct si7006_trace_record);
+	trace->header->count = 0;
+	trace->loaded = 0;
+	trace->dropped = 0;
+	trace->replaying = false;
+	trace->start = ktime_get();
+	trace->recording = true;
+
+unlock:
+	mutex_unlock(&data->update_lock);
+
+	return ret;
+}
+
+DEFINE_DEBUGFS_ATTRIBUTE(si7006_trace_record_fops, si7006_trace_record_get,
+			si7006_trace_record_set, "%llu\n");
+
+static int si7006_trace_replay_get(void *arg, u64 *val)
+{
+	struct si7006_private *data = arg;
+
+	*val = data->trace->replaying;
+
+	return 0;
+}
+
+/**
+ * @brief Start or stop replaying the loaded trace
+ * @details The trace is validated first: it must have been recorded by a
+ * driver with the same trace format.
+ */
+static int si7006_trace_replay_set(void *arg, u64 val)
+{
+	struct si7006_private *data = arg;
+	struct si7006_trace *trace = data->trace;
+	struct si7006_trace_header *header = trace->header;
+	int ret = 0;
+
+	mutex_lock(&data->update_lock);
+
+	if (!val) {
+		trace->replaying = false;
+		goto unlock;
+	}
+
+	if (!header || trace->loaded < sizeof(*header) ||
+			header->magic != SI7006_TRACE_MAGIC ||
+			header->version != SI7006_TRACE_VERSION ||
+			header->record_size != sizeof(struct si7006_trace_record) ||
+			header->count > (trace->loaded - sizeof(*header)) /
+				sizeof(struct si7006_trace_record)) {
+		ret = -EINVAL;
+		goto unlock;
+	}
+
+	trace->recording = false;
+	trace->pos = 0;
+	trace->mismatches = 0;
+	trace->replaying = true;
+
+unlock:
+	mutex_unlock(&data->update_lock);
+
+	return ret;
+}
+
+DEFINE_DEBUGFS_ATTRIBUTE(si7006_trace_replay_fops, si7006_trace_replay_get,
+			si7006_trace_replay_set, "%llu\n");
+
+/**
+ * @brief Create the trace attributes of a sensor
+ * @param [in] data struct si7006_private pointer
+ * @param [in] dir debugfs directory of the sensor
+ */
+static void si7006_trace_register(struct si7006_private *data,
+			struct dentry *dir)
+{
+	struct si7006_trace *trace;
+
+	trace = devm_kzalloc(&data->client->dev, sizeof(*trace), GFP_KERNEL);
+	if (!trace)
+		return;
+
+	data->trace = trace;
+
+	debugfs_create_file("trace", 0600, dir, data, &si7006_trace_fops);
+	debugfs_create_file_unsafe("trace_record", 0600, dir, data,
+				&si7006_trace_record_fops);
+	debugfs_create_file_unsafe("trace_replay", 0600, dir, data,
+				&si7006_trace_replay_fops);
+	debugfs_create_u32("trace_dropped", 0400, dir, &trace->dropped);
+	debugfs_create_u32("trace_mismatches", 0400, dir, &trace->mismatches);
+}
+
+/****************************************************************************
+ * RELAY CHANNEL
+ ****************************************************************************/
+
+#ifdef CONFIG_RELAY
+
+/**
+ * @brief Log the raw codes of a conversion
+ * @param [in] data struct si7006_private pointer
+ * @param [in] temp_code raw temperature code
+ * @param [in] rh_code raw humidity code
+ * @details Must be called with update_lock held. Does nothing unless the
+ * relay channel is open.
+ */
+void si7006_relay_log(struct si7006_private *data, u16 temp_code, u16 rh_code)
+{
+	struct si7006_relay_record rec;
+
+	if (!data->relay)
+		return;
+
+	rec.timestamp_ns = ktime_get_ns();
+	rec.seq = ++data->relay_seq;
+	rec.temperature_code = temp_code;
+	rec.humidity_code = rh_code;
+	rec.resolution = data->resolution;
+	rec.bus_mode = data->bus_mode;
+
+	relay_write(data->relay, &rec, sizeof(rec));
+}
+
+/**
+ * @brief Start a relay sub-buffer
+ * @details The channel doesn't overwrite: records are dropped, and counted,
+ * while the consumer is behind.
+ */
+static int si7006_relay_subbuf_start(struct rchan_buf *buf, void *subbuf,
+			void *prev_subbuf, size_t prev_padding)
+{
+	struct si7006_private *data = buf->chan->private_data;
+
+	if (relay_buf_full(buf)) {
+		data->relay_dropped++;
+		return 0;
+	}
+
+	return 1;
+}
+
+static struct dentry *si7006_relay_create_buf_file(const char *filename,
+			struct dentry *parent, umode_t mode,
+			struct rchan_buf *buf, int *is_global)
+{
+	/* Writes are serialized by update_lock, one buffer is enough */
+	*is_global = 1;
+
+	return debugfs_create_file(filename, mode, parent, buf,
+				&relay_file_operations);
+}
+
+static int si7006_relay_remove_buf_file(struct dentry *dentry)
+{
+	debugfs_remove(dentry);
+
+	return 0;
+}
+
+static struct rchan_callbacks si7006_relay_callbacks = {
+	.subbuf_start = si7006_relay_subbuf_start,
+	.create_buf_file = si7006_relay_create_buf_file,
+	.remove_buf_file = si7006_relay_remove_buf_file,
+};
+
+static int si7006_relay_enable_get(void *arg, u64 *val)
+{
+	struct si7006_private *data = arg;
+
+	*val = !!data->relay;
+
+	return 0;
+}
+
+/**
+ * @brief Open or close the relay channel
+ * @details The channel appears as samples0 in the debugfs directory of the
+ * sensor.
+ */
+static int si7006_relay_enable_set(void *arg, u64 val)
+{
+	struct si7006_private *data = arg;
+	struct rchan *relay = NULL;
+	int ret = 0;
+
+	mutex_lock(&data->update_lock);
+
+	if (val && !data->relay) {
+		data->relay = relay_open("samples", data->debugfs,
+					SI7006_RELAY_SUBBUF_SIZE,
+					SI7006_RELAY_N_SUBBUFS,
+					&si7006_relay_callbacks, data);
+		if (!data->relay)
+			ret = -ENOMEM;
+		data->relay_dropped = 0;
+		data->relay_seq = 0;
+	} else if (!val) {
+		relay = data->relay;
+		data->relay = NULL;
+	}
+
+	mutex_unlock(&data->update_lock);
+
+	if (relay)
+		relay_close(relay);
+
+	return ret;
+}
+
+DEFINE_DEBUGFS_ATTRIBUTE(si7006_relay_enable_fops, si7006_relay_enable_get,
+			si7006_relay_enable_set, "%llu\n");
+
+/**
+ * @brief Create the relay attributes of a sensor
+ * @param [in] data struct si7006_private pointer
+ * @param [in] dir debugfs directory of the sensor
+ */
+static void si7006_relay_register(struct si7006_private *data,
+			struct dentry *dir)
+{
+	debugfs_create_file_unsafe("relay_enable", 0600, dir, data,
+				&si7006_relay_enable_fops);
+	debugfs_create_u32("relay_dropped", 0400, dir, &data->relay_dropped);
+}
+
+static void si7006_relay_unregister(struct si7006_private *data)
+{
+	if (data->relay)
+		relay_close(data->relay);
+}
+
+#else
+
+void si7006_relay_log(struct si7006_private *data, u16 temp_code, u16 rh_code)
+{
+}
+
+static void si7006_relay_register(struct si7006_private *data,
+			struct dentry *dir)
+{
+}
+
+static void si7006_relay_unregister(struct si7006_private *data)
+{
+}
+
+#endif /* CONFIG_RELAY */
+
+/****************************************************************************
+ * DEBUGFS
+ ****************************************************************************/
+
+/**
+ * @brief Remove the debugfs directory of a sensor
+ * @param [in] arg struct si7006_private pointer
+ * @details Registered as devm action.
+ */
+static void si7006_debugfs_unregister(void *arg)
+{
+	struct si7006_private *data = arg;
+
+	si7006_relay_unregister(data);
+	debugfs_remove_recursive(data->debugfs);
+	if (data->trace)
+		vfree(data->trace->header);
+}
+
+/**
+ * @brief Create the debugfs directory of a sensor
+ * @param [in] data struct si7006_private pointer
+ * @return 0 if success
+ * @details Creates /sys/kernel/debug/si7006/<bus>-<addr>. Debugfs failures
+ * are not fatal, the sensor works without its debug interface.
+ */
+int si7006_debugfs_register(struct si7006_private *data)
+{
+	struct device *dev = &data->client->dev;
+
+	data->debugfs = debugfs_create_dir(dev_name(dev), si7006_debugfs_root);
+	si7006_fault_register(data, data->debugfs);
+	si7006_trace_register(data, data->debugfs);
+	si7006_relay_register(data, data->debugfs);
+
+	return devm_add_action_or_reset(dev, si7006_debugfs_unregister, data);
+}
+
+void si7006_debugfs_init(void)
+{
+	si7006_debugfs_root = debugfs_create_dir("si7006", NULL);
+}
+
+void si7006_debugfs_exit(void)
+{
+	debugfs_remove_recursive(si7006_debugfs_root);
+}
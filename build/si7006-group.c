@@ -0,0 +1,152 @@
+/*
+ * si7006-group.c - Part of OPEN-EYES-II products, Linux kernel modules for
+ * hardware monitoring
+ * Coordinated sampling of the Si7006 sensors sharing a root I2C adapter.
+ * Author:
+ * Massimiliano Negretti <massimiliano.negretti@open-eyes.it> 2020-07-12
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+
+#include <linux/module.h>
+#include <linux/i2c.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+#include "si7006.h"
+
+/* Groups by root adapter */
+static LIST_HEAD(si7006_groups);
+static DEFINE_MUTEX(si7006_groups_lock);
+
+/**
+ * @brief Group sampling worker
+ * @param [in] work struct work_struct pointer
+ * @details Runs a round and reschedules itself when the first member is
+ * due. Stops when no member is sampled by the group. The worker runs on
+ * the unbound workqueue of the group with a deferrable timer: the members
+ * sampled by the group follow the cpumask of the group workqueue, not their
+ * own.
+ */
+static void si7006_group_work(struct work_struct *work)
+{
+	struct si7006_group *group = container_of(to_delayed_work(work),
+					struct si7006_group, work);
+	unsigned int delay;
+
+	mutex_lock(&group->lock);
+	delay = si7006_group_round(group);
+	if (delay)
+		mod_delayed_work(group->wq, &group->work,
+					msecs_to_jiffies(delay));
+	mutex_unlock(&group->lock);
+}
+
+/**
+ * @brief Remove a sensor from its group
+ * @param [in] arg struct si7006_private pointer
+ * @details Registered as devm action. The last member frees the group.
+ */
+static void si7006_group_leave(void *arg)
+{
+	struct si7006_private *data = arg;
+	struct si7006_group *group = data->group;
+	bool last;
+
+	/* No more kicks from the sensor sampler */
+	mutex_lock(&data->update_lock);
+	data->group_sampling = false;
+	mutex_unlock(&data->update_lock);
+
+	mutex_lock(&si7006_groups_lock);
+	mutex_lock(&group->lock);
+	list_del(&data->group_node);
+	last = list_empty(&group->members);
+	if (last)
+		list_del(&group->node);
+	mutex_unlock(&group->lock);
+	mutex_unlock(&si7006_groups_lock);
+
+	if (last) {
+		cancel_delayed_work_sync(&group->work);
+		destroy_workqueue(group->wq);
+		kfree(group);
+	}
+}
+
+/**
+ * @brief Add a sensor to the group of its root adapter
+ * @param [in] data struct si7006_private pointer
+ * @return 0 if success
+ * @details Sensors behind the channels of a mux share the group of the
+ * adapter the mux hangs from, since they share the wires.
+ */
+int si7006_group_join(struct si7006_private *data)
+{
+	struct i2c_adapter *root = i2c_root_adapter(&data->client->dev);
+	struct si7006_group *group;
+
+	if (!root)
+		return -ENODEV;
+
+	mutex_lock(&si7006_groups_lock);
+
+	list_for_each_entry(group, &si7006_groups, node) {
+		if (group->root == root)
+			goto join;
+	}
+
+	group = kzalloc(sizeof(*group), GFP_KERNEL);
+	if (!group) {
+		mutex_unlock(&si7006_groups_lock);
+		return -ENOMEM;
+	}
+	group->wq = alloc_workqueue("si7006-group-%d",
+			WQ_UNBOUND | WQ_FREEZABLE | WQ_SYSFS, 0, i2c_adapter_id(root));
+	if (!group->wq) {
+		kfree(group);
+		mutex_unlock(&si7006_groups_lock);
+		return -ENOMEM;
+	}
+	group->root = root;
+	INIT_LIST_HEAD(&group->members);
+	mutex_init(&group->lock);
+	INIT_DEFERRABLE_WORK(&group->work, si7006_group_work);
+	list_add_tail(&group->node, &si7006_groups);
+
+join:
+	mutex_lock(&group->lock);
+	data->group = group;
+	list_add_tail(&data->group_node, &group->members);
+	mutex_unlock(&group->lock);
+
+	mutex_unlock(&si7006_groups_lock);
+
+	return devm_add_action_or_reset(&data->client->dev,
+				si7006_group_leave, data);
+}
+
+/**
+ * @brief Run a round of the sensor group now
+ * @param [in] data struct si7006_private pointer
+ * @details Called with update_lock held, the round itself runs later from
+ * the group worker.
+ */
+void si7006_group_kick(struct si7006_private *data)
+{
+	mod_delayed_work(data->group->wq, &data->group->work, 0);
+}
@@ -0,0 +1,159 @@
+/*
+ * si7006-netlink.c - Part of OPEN-EYES-II products, Linux kernel modules for
+ * hardware monitoring
+ * Generic netlink multicast of the Si7006 samples.
+ * Author:
+ * Massimiliano Negretti <massimiliano.negretti@open-eyes.it> 2020-07-12
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <linux/module.h>
+#include <linux/i2c.h>
+#include <net/genetlink.h>
+#include "si7006.h"
+#include "si7006-uapi.h"
+
+enum si7006_genl_mcgrp {
+	SI7006_MCGRP_SAMPLES,
+};
+
+static const struct genl_multicast_group si7006_genl_mcgrps[] = {
+	[SI7006_MCGRP_SAMPLES] = { .name = SI7006_GENL_MCGRP_SAMPLES },
+};
+
+static struct genl_family si7006_genl_family = {
+	.name = SI7006_GENL_NAME,
+	.version = SI7006_GENL_VERSION,
+	.maxattr = SI7006_ATTR_MAX,
+	.module = THIS_MODULE,
+	.mcgrps = si7006_genl_mcgrps,
+	.n_mcgrps = ARRAY_SIZE(si7006_genl_mcgrps),
+};
+
+/**
+ * @brief Start a multicast message
+ * @param [in] data struct si7006_private pointer
+ * @param [in] cmd enum si7006_genl_cmd
+ * @param [out] hdr message header
+ * @return the message, NULL if nobody listens or on failure
+ * @details The message starts with the identity of the instance.
+ */
+static struct sk_buff *si7006_genl_start(struct si7006_private *data, u8 cmd,
+			void **hdr)
+{
+	struct sk_buff *skb;
+
+	if (!genl_has_listeners(&si7006_genl_family, &init_net,
+				SI7006_MCGRP_SAMPLES))
+		return NULL;
+
+	skb = genlmsg_new(NLMSG_DEFAULT_SIZE, GFP_KERNEL);
+	if (!skb)
+		return NULL;
+
+	*hdr = genlmsg_put(skb, 0, 0, &si7006_genl_family, 0, cmd);
+	if (!*hdr)
+		goto error;
+
+	if (nla_put_string(skb, SI7006_ATTR_DEVICE, dev_name(&data->client->dev)))
+		goto error;
+	if (data->hwmon_dev && nla_put_string(skb, SI7006_ATTR_HWMON,
+				dev_name(data->hwmon_dev)))
+		goto error;
+
+	return skb;
+
+error:
+	nlmsg_free(skb);
+	return NULL;
+}
+
+/**
+ * @brief Send a multicast message
+ * @param [in] skb message
+ * @param [in] hdr message header
+ */
+static void si7006_genl_send(struct sk_buff *skb, void *hdr)
+{
+	genlmsg_end(skb, hdr);
+	genlmsg_multicast(&si7006_genl_family, skb, 0, SI7006_MCGRP_SAMPLES,
+				GFP_KERNEL);
+}
+
+/**
+ * @brief Multicast a new sample
+ * @param [in] data struct si7006_private pointer
+ * @param [in] sample struct si7006_sample pointer
+ * @details Costs nothing more than a listener check when nobody subscribed
+ * the samples group.
+ */
+void si7006_netlink_sample(struct si7006_private *data,
+			const struct si7006_sample *sample)
+{
+	struct sk_buff *skb;
+	void *hdr;
+
+	skb = si7006_genl_start(data, SI7006_CMD_SAMPLE, &hdr);
+	if (!skb)
+		return;
+
+	if (nla_put_u64_64bit(skb, SI7006_ATTR_SEQ, sample->seq,
+				SI7006_ATTR_PAD) ||
+	    nla_put_u64_64bit(skb, SI7006_ATTR_TIMESTAMP,
+				ktime_to_ns(sample->timestamp), SI7006_ATTR_PAD) ||
+	    nla_put_s32(skb, SI7006_ATTR_TEMPERATURE, sample->temperature) ||
+	    nla_put_s32(skb, SI7006_ATTR_HUMIDITY, sample->humidity) ||
+	    nla_put_s32(skb, SI7006_ATTR_DEW_POINT, sample->dew_point)) {
+		nlmsg_free(skb);
+		return;
+	}
+
+	si7006_genl_send(skb, hdr);
+}
+
+/**
+ * @brief Multicast an alarm transition
+ * @param [in] data struct si7006_private pointer
+ * @param [in] alarm enum si7006_alarm
+ * @param [in] active true when the alarm is raised
+ */
+void si7006_netlink_alarm(struct si7006_private *data, u32 alarm, bool active)
+{
+	struct sk_buff *skb;
+	void *hdr;
+
+	skb = si7006_genl_start(data, SI7006_CMD_ALARM, &hdr);
+	if (!skb)
+		return;
+
+	if (nla_put_u32(skb, SI7006_ATTR_ALARM, alarm) ||
+	    nla_put_u8(skb, SI7006_ATTR_ALARM_ACTIVE, active)) {
+		nlmsg_free(skb);
+		return;
+	}
+
+	si7006_genl_send(skb, hdr);
+}
+
+int si7006_netlink_init(void)
+{
+	return genl_register_family(&si7006_genl_family);
+}
+
+void si7006_netlink_exit(void)
+{
+	genl_unregister_family(&si7006_genl_family);
+}
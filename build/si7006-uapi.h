@@ -0,0 +1,185 @@
+/*
+ * si7006-uapi.h - Part of OPEN-EYES-II products, Linux kernel modules for
+ * hardware monitoring
+ *
+ * Author:
+ * Massimiliano Negretti <massimiliano.negretti@open-eyes.it> 2020-07-12
+ *
+ * Userspace interface of si7006-hwmon Linux driver
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef _SI7006_UAPI_H
+#define _SI7006_UAPI_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/****************************************************************************
+ * GENERIC NETLINK
+ ****************************************************************************/
+
+#define SI7006_GENL_NAME                                "si7006"
+#define SI7006_GENL_VERSION                             1
+#define SI7006_GENL_MCGRP_SAMPLES                       "samples"
+
+/* Multicast messages */
+enum si7006_genl_cmd {
+	SI7006_CMD_UNSPEC,
+	SI7006_CMD_SAMPLE,              /* new sample published */
+	SI7006_CMD_ALARM,               /* alarm transition */
+	__SI7006_CMD_MAX,
+};
+#define SI7006_CMD_MAX (__SI7006_CMD_MAX - 1)
+
+enum si7006_genl_attr {
+	SI7006_ATTR_UNSPEC,
+	SI7006_ATTR_PAD,
+	SI7006_ATTR_DEVICE,             /* string, I2C device name "1-0040" */
+	SI7006_ATTR_HWMON,              /* string, hwmon device name "hwmon0" */
+	SI7006_ATTR_SEQ,                /* u64, sample sequence number */
+	SI7006_ATTR_TIMESTAMP,          /* u64, CLOCK_MONOTONIC ns */
+	SI7006_ATTR_TEMPERATURE,        /* s32, milli celsius */
+	SI7006_ATTR_HUMIDITY,           /* s32, milli %RH */
+	SI7006_ATTR_DEW_POINT,          /* s32, milli celsius */
+	SI7006_ATTR_ALARM,              /* u32, enum si7006_alarm */
+	SI7006_ATTR_ALARM_ACTIVE,       /* u8, 1 raised, 0 cleared */
+	__SI7006_ATTR_MAX,
+};
+#define SI7006_ATTR_MAX (__SI7006_ATTR_MAX - 1)
+
+enum si7006_alarm {
+	SI7006_ALARM_FAULT,             /* sensor not answering */
+};
+
+/****************************************************************************
+ * SAMPLE PAGE
+ ****************************************************************************/
+
+/* Sample status flags */
+#define SI7006_FLAG_VALID                               (1 << 0)
+#define SI7006_FLAG_FAULT                               (1 << 1)
+#define SI7006_FLAG_HEATER                              (1 << 2)
+
+/*
+ * Read-only page mapped from /dev/si7006-<bus>-<addr>.
+ * The driver increments lock before and after every update, so lock is odd
+ * while the page is being written. A reader copies the page between two reads
+ * of lock and retries when they differ or are odd, see si7006_page_read().
+ */
+struct si7006_shared_page {
+	__u32 lock;
+	__u32 flags;                    /* SI7006_FLAG_* */
+	__u64 seq;                      /* sample sequence number */
+	__u64 timestamp_ns;             /* CLOCK_MONOTONIC */
+	__s32 temperature;              /* milli celsius */
+	__s32 humidity;                 /* milli %RH */
+	__s32 min_temperature;
+	__s32 max_temperature;
+	__s32 min_humidity;
+	__s32 max_humidity;
+	__s32 dew_point;                /* milli celsius */
+	__s32 reserved;
+};
+
+/****************************************************************************
+ * CHARACTER DEVICE IOCTLS
+ ****************************************************************************/
+
+struct si7006_ioc_sample {
+	__u64 seq;                      /* sample sequence number */
+	__u64 timestamp_ns;             /* CLOCK_MONOTONIC */
+	__s32 temperature;              /* milli celsius */
+	__s32 humidity;                 /* milli %RH */
+	__s32 dew_point;                /* milli celsius */
+	__u32 flags;                    /* SI7006_FLAG_* */
+};
+
+#define SI7006_IOC_MAGIC                                'S'
+/* Max sample age in ms accepted by this file, 0 removes the contract */
+#define SI7006_IOC_SET_MAX_AGE          _IOW(SI7006_IOC_MAGIC, 1, __u32)
+#define SI7006_IOC_GET_MAX_AGE          _IOR(SI7006_IOC_MAGIC, 2, __u32)
+/* Sample not older than the max age of this file */
+#define SI7006_IOC_READ_SAMPLE          _IOR(SI7006_IOC_MAGIC, 3, \
+						struct si7006_ioc_sample)
+
+/****************************************************************************
+ * BUS TRACE
+ ****************************************************************************/
+
+/*
+ * A trace file is a struct si7006_trace_header followed by count records,
+ * one per I2C message, in host byte order.
+ */
+#define SI7006_TRACE_MAGIC                              0x54374953 /* SI7T */
+#define SI7006_TRACE_VERSION                            1
+#define SI7006_TRACE_MAX_LEN                            8
+
+/* Record flags */
+#define SI7006_TRACE_READ                               (1 << 0)
+
+struct si7006_trace_header {
+	__u32 magic;                    /* SI7006_TRACE_MAGIC */
+	__u16 version;                  /* SI7006_TRACE_VERSION */
+	__u16 record_size;              /* sizeof(struct si7006_trace_record) */
+	__u32 count;                    /* number of records */
+	__u32 reserved;
+};
+
+struct si7006_trace_record {
+	__u64 timestamp_ns;             /* since the start of the recording */
+	__u32 duration_ns;              /* time spent in the message */
+	__s16 error;                    /* 0 or -errno */
+	__u8 flags;                     /* SI7006_TRACE_* */
+	__u8 len;                       /* message length */
+	__u8 buf[SI7006_TRACE_MAX_LEN]; /* command sent or result received */
+};
+
+/****************************************************************************
+ * RELAY CHANNEL
+ ****************************************************************************/
+
+/* One record per conversion, packed back to back in the relay buffer */
+struct si7006_relay_record {
+	__u64 timestamp_ns;             /* CLOCK_MONOTONIC */
+	__u32 seq;                      /* +1 per conversion, gaps are drops */
+	__u16 temperature_code;         /* raw code, as read from the sensor */
+	__u16 humidity_code;            /* raw code, as read from the sensor */
+	__u8 resolution;                /* RES1:RES0 of user register 1 */
+	__u8 bus_mode;                  /* enum si7006_bus_mode */
+} __attribute__((packed));
+
+#ifndef __KERNEL__
+/**
+ * @brief Read a consistent copy of the sample page
+ * @param [in] page mapped page
+ * @param [out] copy consistent copy
+ */
+static inline void si7006_page_read(const volatile struct si7006_shared_page *page,
+			struct si7006_shared_page *copy)
+{
+	__u32 lock;
+
+	do {
+		lock = __atomic_load_n(&page->lock, __ATOMIC_ACQUIRE);
+		*copy = *(const struct si7006_shared_page *)page;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while ((lock & 1) || lock != __atomic_load_n(&page->lock,
+							__ATOMIC_RELAXED));
+}
+#endif
+
+#endif /* _SI7006_UAPI_H */
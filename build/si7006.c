@@ -1,7 +1,8 @@
 /*
  * si7006.c - Part of OPEN-EYES-II products, Linux kernel modules for hardware
  * monitoring
- * This driver handles the Si7006 temperature and humidity sensor.
+ * This driver handles the Si7006 temperature and humidity sensor, and the
+ * compatible Si7013/Si7020/Si7021, HTU21D and SHT21.
  * Author:
  * Massimiliano Negretti <massimiliano.negretti@open-eyes.it> 2020-07-12
  *
@@ -23,404 +24,3070 @@
 #include <linux/module.h>
 #include <linux/i2c.h>
 #include <linux/hwmon.h>
+#include <linux/delay.h>
+#include <linux/jiffies.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/of.h>
+#include <linux/property.h>
+#include <linux/seqlock.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
 #include "si7006.h"
+#include "si7006-uapi.h"
+
+/* Conversion times of the Si70xx variants, the same for all of them */
+#define SI70XX_RH_CONV_US       { 12000, 3100, 4500, 7000 }
+#define SI70XX_TEMP_CONV_US     { 10800, 3800, 6200, 2400 }
+#define SI7006_RH_BITS          { 12, 8, 10, 11 }
+#define SI7006_TEMP_BITS        { 14, 12, 13, 11 }
+
+static const struct si7006_variant si7006_variants[] = {
+	[SI7006] = {
+		.name = "si7006",
+		.id = ID_SI7006,
+		.has_old_temp = true,
+		.has_heater_level = true,
+		.rh_bits = SI7006_RH_BITS,
+		.temp_bits = SI7006_TEMP_BITS,
+		.rh_conv_us = SI70XX_RH_CONV_US,
+		.temp_conv_us = SI70XX_TEMP_CONV_US,
+	},
+	[SI7013] = {
+		.name = "si7013",
+		.id = ID_SI7013,
+		.has_old_temp = true,
+		.has_heater_level = true,
+		.rh_bits = SI7006_RH_BITS,
+		.temp_bits = SI7006_TEMP_BITS,
+		.rh_conv_us = SI70XX_RH_CONV_US,
+		.temp_conv_us = SI70XX_TEMP_CONV_US,
+	},
+	[SI7020] = {
+		.name = "si7020",
+		.id = ID_SI7020,
+		.has_old_temp = true,
+		.has_heater_level = true,
+		.rh_bits = SI7006_RH_BITS,
+		.temp_bits = SI7006_TEMP_BITS,
+		.rh_conv_us = SI70XX_RH_CONV_US,
+		.temp_conv_us = SI70XX_TEMP_CONV_US,
+	},
+	[SI7021] = {
+		.name = "si7021",
+		.id = ID_SI7021,
+		.has_old_temp = true,
+		.has_heater_level = true,
+		.rh_bits = SI7006_RH_BITS,
+		.temp_bits = SI7006_TEMP_BITS,
+		.rh_conv_us = SI70XX_RH_CONV_US,
+		.temp_conv_us = SI70XX_TEMP_CONV_US,
+	},
+	/* No electronic ID, no read temperature command, heater on/off only */
+	[HTU21] = {
+		.name = "htu21",
+		.rh_bits = SI7006_RH_BITS,
+		.temp_bits = SI7006_TEMP_BITS,
+		.rh_conv_us = { 16000, 3000, 5000, 8000 },
+		.temp_conv_us = { 50000, 13000, 25000, 7000 },
+	},
+	[SHT21] = {
+		.name = "sht21",
+		.rh_bits = SI7006_RH_BITS,
+		.temp_bits = SI7006_TEMP_BITS,
+		.rh_conv_us = { 29000, 4000, 9000, 15000 },
+		.temp_conv_us = { 85000, 22000, 43000, 11000 },
+	},
+};
 
 static const struct i2c_device_id si7006_id[] = {
-	{ "si7006", 0 },
+	{ "si7006", SI7006 },
+	{ "si7013", SI7013 },
+	{ "si7020", SI7020 },
+	{ "si7021", SI7021 },
+	{ "htu21", HTU21 },
+	{ "sht21", SHT21 },
 	{ }
 };
 MODULE_DEVICE_TABLE(i2c, si7006_id);
 
+static const struct of_device_id si7006_of_match[] = {
+	{ .compatible = "silabs,si7006", .data = &si7006_variants[SI7006] },
+	{ .compatible = "silabs,si7013", .data = &si7006_variants[SI7013] },
+	{ .compatible = "silabs,si7020", .data = &si7006_variants[SI7020] },
+	{ .compatible = "silabs,si7021", .data = &si7006_variants[SI7021] },
+	{ .compatible = "meas,htu21", .data = &si7006_variants[HTU21] },
+	{ .compatible = "sensirion,sht21", .data = &si7006_variants[SHT21] },
+	/* Legacy compatible of the first overlays */
+	{ .compatible = "i2c,si7006", .data = &si7006_variants[SI7006] },
+	{ }
+};
+MODULE_DEVICE_TABLE(of, si7006_of_match);
+
+/****************************************************************************
+ * I2C TRANSFER FUNCTIONS
+ ****************************************************************************/
+
 /**
- * @brief HWMON function to get temperature
- * @param [in] dev struct device pointer
- * @param [in] data struct si7006_private pointer
- * @param [out] val temperature value
- * @return 0 if success
- * @details Returns the temperature measured from Si7006 sensor.
+ * @brief Select the fastest transfer method of the adapter
+ * @param [in] adap struct i2c_adapter pointer
+ * @return SI7006_XFER_* method, negative error if the adapter can't be used
+ * @details A plain I2C adapter sends the command and reads the result in one
+ * combined transfer, unless its quirks forbid repeated starts. SMBus only
+ * controllers use the byte and word data commands, and can't read a result
+ * without sending a command first: they need the hold master measure, so
+ * they must tolerate clock stretching.
  */
-static int si7006_get_master_temperature(struct device *dev,
-				      struct si7006_private *data, long *val)
+static int si7006_select_xfer(struct i2c_adapter *adap)
 {
-	char buf[2];
-	long long temp;
-	int raw_temp;
-	int  ret;
+	if (i2c_check_functionality(adap, I2C_FUNC_I2C)) {
+		if (i2c_check_quirks(adap, I2C_AQ_NO_REP_START))
+			return SI7006_XFER_SPLIT;
+		return SI7006_XFER_COMBINED;
+	}
 
-	/* Put the command into the buffer */
-	buf[0] = SI7006_MEAS_TEMP_MASTER_MODE;
+	if (i2c_check_functionality(adap, I2C_FUNC_SMBUS_BYTE |
+				I2C_FUNC_SMBUS_BYTE_DATA |
+				I2C_FUNC_SMBUS_READ_WORD_DATA) &&
+			!i2c_check_quirks(adap, I2C_AQ_NO_CLK_STRETCH))
+		return SI7006_XFER_SMBUS;
 
-	/* Send the command */
-	ret = i2c_master_send(data->client, buf, 1);
-	if (ret < 0)
-				 return ret;
+	return -EOPNOTSUPP;
+}
 
-	/* Receive the 2-byte result */
-	ret = i2c_master_recv(data->client, buf, 2);
+/**
+ * @brief Run one SMBus transaction
+ * @param [in] client struct i2c_client pointer
+ * @param [in] cmd command bytes
+ * @param [in] cmd_len number of command bytes, 0 to only read
+ * @param [out] buf result buffer
+ * @param [in] len number of bytes to read, 0 if none
+ * @return 0 if success, EOPNOTSUPP if no SMBus command fits
+ * @details The sensor sends its results MSB first, the opposite of the
+ * SMBus words.
+ */
+static int si7006_smbus_xfer(struct i2c_client *client, const u8 *cmd,
+			int cmd_len, u8 *buf, int len)
+{
+	int ret;
+
+	if (cmd_len == 1 && !len)
+		return i2c_smbus_write_byte(client, cmd[0]);
+	if (cmd_len == 2 && !len)
+		return i2c_smbus_write_byte_data(client, cmd[0], cmd[1]);
+
+	if (!cmd_len && len == 1)
+		ret = i2c_smbus_read_byte(client);
+	else if (cmd_len == 1 && len == 1)
+		ret = i2c_smbus_read_byte_data(client, cmd[0]);
+	else if (cmd_len == 1 && len == 2)
+		ret = i2c_smbus_read_word_swapped(client, cmd[0]);
+	else if (cmd_len == 1 && len <= I2C_SMBUS_BLOCK_MAX &&
+			i2c_check_functionality(client->adapter,
+					I2C_FUNC_SMBUS_READ_I2C_BLOCK))
+		return i2c_smbus_read_i2c_block_data(client, cmd[0], len,
+					buf) == len ? 0 : -EIO;
+	else
+		return -EOPNOTSUPP;
 	if (ret < 0)
 		return ret;
 
-	raw_temp = buf[1] + buf[0]*256;
-	temp = ((long long)(raw_temp)*175720)/65536-46850;
-	*val = (long)temp;
+	if (len == 2) {
+		buf[0] = ret >> 8;
+		buf[1] = ret & 0xFF;
+	} else {
+		buf[0] = ret;
+	}
 
 	return 0;
 }
 
 /**
- * @brief HWMON function to get humidity
- * @param [in] dev struct device pointer
+ * @brief Run one bus transaction
  * @param [in] data struct si7006_private pointer
- * @param [out] val humidity value
+ * @param [in] cmd command bytes
+ * @param [in] cmd_len number of command bytes, 0 to only read
+ * @param [out] buf result buffer
+ * @param [in] len number of bytes to read, 0 if none
  * @return 0 if success
- * @details Returns the humidity measured from Si7006 sensor.
+ * @details A command followed by a read is a combined transaction (repeated
+ * start). When the measure sequence holds the adapter lock the unlocked
+ * transfer is used; the SMBus method never locks the adapter, since it only
+ * runs the hold master measure.
  */
-static int si7006_get_master_humidity(struct device *dev,
-				      struct si7006_private *data, long *val)
+static int si7006_bus_xfer(struct si7006_private *data, const u8 *cmd,
+			int cmd_len, u8 *buf, int len)
 {
-	char buf[6];
-	long long humidity;
-	int raw_humidity;
-	int  ret;
+	struct i2c_client *client = data->client;
+	struct i2c_msg msgs[2];
+	int n = 0;
+	int ret;
 
-	/* Put the command into the buffer */
-	buf[0] = SI7006_MEAS_REL_HUMIDITY_MASTER_MODE;
+	if (data->xfer_method == SI7006_XFER_SMBUS)
+		return si7006_smbus_xfer(client, cmd, cmd_len, buf, len);
 
-	/* Send the command */
-	ret = i2c_master_send(data->client, buf, 1);
-	if (ret < 0)
-				 return ret;
+	if (cmd_len) {
+		msgs[n].addr = client->addr;
+		msgs[n].flags = client->flags & I2C_M_TEN;
+		msgs[n].len = cmd_len;
+		msgs[n].buf = (u8 *)cmd;
+		n++;
+	}
+	if (len) {
+		msgs[n].addr = client->addr;
+		msgs[n].flags = (client->flags & I2C_M_TEN) | I2C_M_RD;
+		msgs[n].len = len;
+		msgs[n].buf = buf;
+		n++;
+	}
 
-	/* Receive the 2-byte result */
-	ret = i2c_master_recv(data->client, buf, 2);
+	if (data->bus_locked)
+		ret = __i2c_transfer(client->adapter, msgs, n);
+	else
+		ret = i2c_transfer(client->adapter, msgs, n);
 	if (ret < 0)
 		return ret;
 
-	raw_humidity = buf[1] + buf[0]*256;
+	return ret == n ? 0 : -EIO;
+}
+
+/**
+ * @brief Run one transaction with the sensor
+ * @param [in] data struct si7006_private pointer
+ * @param [in] cmd command bytes
+ * @param [in] cmd_len number of command bytes, 0 to only read
+ * @param [out] buf result buffer
+ * @param [in] len number of bytes to read, 0 if none
+ * @return 0 if success
+ * @details Injected faults, if enabled, are applied here, and the messages
+ * are recorded in the bus trace or served from a replayed one. A combined
+ * transaction is traced as its write message, with the duration and error
+ * of the whole transaction, followed by its read message when it succeeds,
+ * so the trace doesn't depend on the transfer method.
+ */
+static int si7006_xfer_txn(struct si7006_private *data, const u8 *cmd,
+			int cmd_len, u8 *buf, int len)
+{
+	ktime_t start = ktime_get();
+	int ret;
+
+	if (si7006_trace_replaying(data)) {
+		ret = 0;
+		if (cmd_len)
+			ret = si7006_trace_replay(data, 0, (u8 *)cmd, cmd_len);
+		if (ret == 0 && len)
+			ret = si7006_trace_replay(data, I2C_M_RD, buf, len);
+		return ret;
+	}
+
+	ret = si7006_fault_inject(data);
+	if (ret == 0)
+		ret = si7006_bus_xfer(data, cmd, cmd_len, buf, len);
+	if (ret == 0 && len)
+		si7006_fault_corrupt(data, buf, len);
+
+	if (cmd_len)
+		si7006_trace_record(data, start, 0, cmd, cmd_len, ret);
+	if (len && (!cmd_len || ret == 0))
+		si7006_trace_record(data, cmd_len ? ktime_get() : start,
+					I2C_M_RD, buf, len, ret);
+
+	return ret;
+}
+
+/**
+ * @brief Send a command and optionally read back its result
+ * @param [in] data struct si7006_private pointer
+ * @param [in] cmd command bytes
+ * @param [in] cmd_len number of command bytes, 0 to only read
+ * @param [out] buf result buffer
+ * @param [in] len number of bytes to read, 0 if none
+ * @return 0 if success
+ * @details Every exchange with the sensor goes through this helper, which
+ * also accounts the time the bus is busy with it. The command and the read
+ * are combined in one transaction when the transfer method allows it,
+ * otherwise they are sent as two.
+ */
+static int si7006_xfer(struct si7006_private *data, const u8 *cmd, int cmd_len,
+			u8 *buf, int len)
+{
+	ktime_t start = ktime_get();
+	bool combined;
+	int ret = 0;
+
+	combined = cmd_len && len &&
+		(data->xfer_method == SI7006_XFER_COMBINED ||
+		 (data->xfer_method == SI7006_XFER_SMBUS && cmd_len == 1));
+
+	if (combined) {
+		ret = si7006_xfer_txn(data, cmd, cmd_len, buf, len);
+		goto out;
+	}
+
+	/* Send the command, if any */
+	if (cmd_len) {
+		ret = si7006_xfer_txn(data, cmd, cmd_len, NULL, 0);
+		if (ret < 0)
+			goto out;
+	}
+
+	/* Receive the result */
+	if (len)
+		ret = si7006_xfer_txn(data, NULL, 0, buf, len);
+
+out:
+	data->bus_busy_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+	return ret;
+}
+
+/**
+ * @brief Read a one byte control register
+ * @param [in] data struct si7006_private pointer
+ * @param [in] cmd read command of the register
+ * @param [out] val register value
+ * @return 0 if success
+ */
+static int si7006_read_reg(struct si7006_private *data, u8 cmd, u8 *val)
+{
+	return si7006_xfer(data, &cmd, 1, val, 1);
+}
+
+/**
+ * @brief Write a one byte control register
+ * @param [in] data struct si7006_private pointer
+ * @param [in] cmd write command of the register
+ * @param [in] val register value
+ * @return 0 if success
+ */
+static int si7006_write_reg(struct si7006_private *data, u8 cmd, u8 val)
+{
+	u8 buf[2] = { cmd, val };
+
+	return si7006_xfer(data, buf, 2, NULL, 0);
+}
+
+/****************************************************************************
+ * REGISTER CACHE
+ ****************************************************************************/
+
+static const struct {
+	u8 read_cmd;
+	u8 write_cmd;
+} si7006_regs[SI7006_NUM_CACHED_REGS] = {
+	[SI7006_REG_USER] = { SI7006_READ_HUMIDITY_TEMP_CONTR,
+				SI7006_WRITE_HUMIDITY_TEMP_CONTR },
+	[SI7006_REG_HEATER] = { SI7006_READ_HEATER_CONTR,
+				SI7006_WRITE_HEATER_CONTR },
+};
+
+/**
+ * @brief Read a control register through the cache
+ * @param [in] data struct si7006_private pointer
+ * @param [in] reg enum si7006_reg
+ * @param [out] val register value
+ * @return 0 if success
+ * @details Must be called with update_lock held. Only the first read of a
+ * register, or the first after it has been invalidated, reaches the sensor.
+ */
+static int si7006_reg_read(struct si7006_private *data, enum si7006_reg reg,
+			u8 *val)
+{
+	int ret;
+
+	if (!data->regs[reg].valid) {
+		ret = si7006_read_reg(data, si7006_regs[reg].read_cmd,
+					&data->regs[reg].val);
+		if (ret < 0)
+			return ret;
+		data->regs[reg].valid = true;
+	}
 
-	humidity = ((long long)(raw_humidity)*125000)/65536-6000;
-	*val = (long)humidity;
+	*val = data->regs[reg].val;
 
 	return 0;
 }
 
 /**
- * @brief HWMON function to get temperature
- * @param [in] dev struct device pointer
+ * @brief Read-modify-write a control register through the cache
+ * @param [in] data struct si7006_private pointer
+ * @param [in] reg enum si7006_reg
+ * @param [in] mask bits to change
+ * @param [in] val new value of the bits in mask
  * @return 0 if success
- * @details Returns the temperature from the given register in milli celsius
- * handling mutex and avoid to address sensor when measure are made close
- * in time.
+ * @details Must be called with update_lock held. Reserved bits are preserved
+ * as the datasheet requires, and nothing is written when the register
+ * already holds the requested value.
  */
-static long si7006_get_temperature(struct device *dev)
+static int si7006_reg_update(struct si7006_private *data, enum si7006_reg reg,
+			u8 mask, u8 val)
 {
-	struct si7006_private *data = dev_get_drvdata(dev);
-	long temperature=0;
+	u8 old, new;
 	int ret;
 
-	mutex_lock(&data->update_lock);
+	ret = si7006_reg_read(data, reg, &old);
+	if (ret < 0)
+		return ret;
+
+	new = (old & ~mask) | (val & mask);
+	if (new == old)
+		return 0;
 
-	if (time_after(jiffies, data->temperature_updated + HZ)
-																					|| !data->temperature_valid) {
+	ret = si7006_write_reg(data, si7006_regs[reg].write_cmd, new);
+	if (ret < 0) {
+		/* The write may have reached the sensor or not */
+		data->regs[reg].valid = false;
+		return ret;
+	}
 
-		ret = si7006_get_master_temperature(dev, data, &temperature);
+	data->regs[reg].val = new;
 
-		if (ret < 0) {
-			goto error;
-		}
+	return 0;
+}
 
-		data->temperature=temperature;
-		data->temperature_updated = jiffies;
-		if (data->temperature_valid) {
-			if (temperature>data->max_temperature)
-				data->max_temperature = temperature;
-			if (temperature<data->min_temperature)
-				data->min_temperature = temperature;
-		} else {
-			data->min_temperature = temperature;
-			data->max_temperature = temperature;
-			data->temperature_valid = true;
+/**
+ * @brief Write the cached configuration back to the sensor
+ * @param [in] data struct si7006_private pointer
+ * @return 0 if success
+ * @details Must be called with update_lock held, after the sensor lost its
+ * registers (reset, power loss during suspend). Registers that can't be
+ * restored are invalidated and read again at the next use.
+ */
+static int si7006_reg_restore(struct si7006_private *data)
+{
+	int reg;
+	int ret = 0;
+
+	for (reg = 0; reg < SI7006_NUM_CACHED_REGS; reg++) {
+		if (!data->regs[reg].valid)
+			continue;
+		ret = si7006_write_reg(data, si7006_regs[reg].write_cmd,
+					data->regs[reg].val);
+		if (ret < 0)
+			break;
+	}
+
+	if (ret < 0) {
+		for (reg = 0; reg < SI7006_NUM_CACHED_REGS; reg++)
+			data->regs[reg].valid = false;
+		/* The sensor is left with its default configuration */
+		if (data->heater_enabled) {
+			data->heater_enabled = false;
+			si7006_chardev_update(data);
 		}
-	} else {
-		temperature = data->temperature;
+		data->heater_level = 0;
+		data->resolution = 0;
 	}
 
-error:
-	mutex_unlock(&data->update_lock);
-	return temperature;
+	return ret;
 }
 
 /**
- * @brief HWMON function to get maximum temperature
- * @param [in] dev struct device pointer
- * @return maximum measured temperature
- * @details The function doesn't make any real measure, but simply returns the
- * maximum temperature read by the sensor.
+ * @brief Resolution index of a user register value
+ * @param [in] reg user register 1
+ * @return index in the variant resolution tables
  */
-static long si7006_get_temperature_max(struct device *dev)
+static unsigned int si7006_reg_to_resolution(u8 reg)
 {
-	struct si7006_private *data = dev_get_drvdata(dev);
+	return (reg & SI7006_USER_RES1 ? 2 : 0) | (reg & SI7006_USER_RES0 ? 1 : 0);
+}
 
-	return data->max_temperature;
+/**
+ * @brief User register bits of a resolution index
+ * @param [in] resolution index in the variant resolution tables
+ * @return RES1 and RES0 bits of user register 1
+ */
+static u8 si7006_resolution_to_reg(unsigned int resolution)
+{
+	return (resolution & 2 ? SI7006_USER_RES1 : 0) |
+		(resolution & 1 ? SI7006_USER_RES0 : 0);
 }
 
 /**
- * @brief HWMON function to get minimum temperature
- * @param [in] dev struct device pointer
- * @return maximum measured temperature
- * @details The function doesn't make any real measure, but simply returns the
- * minimum temperature read by the sensor.
+ * @brief Convert a raw humidity code
+ * @param [in] code 16-bit result of the sensor
+ * @return humidity in milli %RH
  */
-static long si7006_get_temperature_min(struct device *dev)
+static long si7006_raw_to_humidity(u16 code)
 {
-	struct si7006_private *data = dev_get_drvdata(dev);
+	/* The two low bits are status bits on the SHT21/HTU21D */
+	int raw = code & ~SI7006_STATUS_MASK;
+	long humidity = (long)(((long long)(raw)*125000)/65536-6000);
 
-	return data->min_temperature;
+	return clamp_val(humidity, 0, 100000);
 }
 
 /**
- * @brief HWMON function to get humidity
+ * @brief Convert a raw temperature code
+ * @param [in] code 16-bit result of the sensor
+ * @return temperature in milli celsius
+ */
+static long si7006_raw_to_temperature(u16 code)
+{
+	/* The two low bits are status bits on the SHT21/HTU21D */
+	int raw = code & ~SI7006_STATUS_MASK;
+
+	return (long)(((long long)(raw)*175720)/65536-46850);
+}
+
+/**
+ * @brief HWMON function to get a temperature/humidity sample
  * @param [in] dev struct device pointer
+ * @param [in] data struct si7006_private pointer
+ * @param [out] temp_code raw temperature code
+ * @param [out] rh_code raw humidity code
  * @return 0 if success
- * @details Returns the humidity from the given register in milli %HR
- * handling mutex and avoid to address sensor when measure are made close
- * in time.
+ * @details Runs a humidity measure and then reads back the temperature the
+ * Si70xx measured during the same conversion, so the pair is consistent and
+ * only one conversion is needed. Variants without the read temperature
+ * command run a second conversion for the temperature.
  */
-static long si7006_get_humidity(struct device *dev)
+static int si7006_get_master_sample(struct device *dev,
+		struct si7006_private *data, u16 *temp_code, u16 *rh_code)
 {
-	struct si7006_private *data = dev_get_drvdata(dev);
-	long humidity=0;
-	int ret;
+	u8 cmd;
+	u8 buf[2];
+	int  ret;
 
-	mutex_lock(&data->update_lock);
+	/* Humidity measure, temperature is measured too */
+	cmd = SI7006_MEAS_REL_HUMIDITY_MASTER_MODE;
+	ret = si7006_xfer(data, &cmd, 1, buf, 2);
+	if (ret < 0)
+		return ret;
 
-	if (time_after(jiffies, data->humidity_updated + HZ)
-																					|| !data->humidity_valid) {
+	*rh_code = (buf[0] << 8) | buf[1];
 
-		ret = si7006_get_master_humidity(dev, data, &humidity);
+	/* Temperature of the previous humidity measure */
+	if (data->variant->has_old_temp)
+		cmd = SI7006_READ_OLD_TEMP;
+	else
+		cmd = SI7006_MEAS_TEMP_MASTER_MODE;
+	ret = si7006_xfer(data, &cmd, 1, buf, 2);
+	if (ret < 0)
+		return ret;
 
-		if (ret < 0) {
-			goto error;
-		}
+	*temp_code = (buf[0] << 8) | buf[1];
 
-		data->humidity=humidity;
-		data->humidity_updated = jiffies;
-		if (data->humidity_valid) {
-			if (humidity>data->max_humidity)
-				data->max_humidity = humidity;
-			if (humidity<data->min_humidity)
-				data->min_humidity = humidity;
-		} else {
-			data->min_humidity = humidity;
-			data->max_humidity = humidity;
-			data->humidity_valid = true;
-		}
+	return 0;
+}
+
+/**
+ * @brief Max duration of a humidity measure
+ * @param [in] data struct si7006_private pointer
+ * @return conversion time in us at the configured resolution
+ * @details The Si70xx humidity measure includes a temperature conversion.
+ */
+static unsigned int si7006_rh_conv_us(struct si7006_private *data)
+{
+	const struct si7006_variant *variant = data->variant;
+	unsigned int conv_us = variant->rh_conv_us[data->resolution];
+
+	if (variant->has_old_temp)
+		conv_us += variant->temp_conv_us[data->resolution];
+
+	return conv_us;
+}
+
+/**
+ * @brief Read the result of a no hold master measure
+ * @param [in] data struct si7006_private pointer
+ * @param [out] buf 2-byte result
+ * @return 0 if success
+ * @details The sensor NACKs the read until the conversion is over: it is
+ * polled again with a short exponential backoff.
+ */
+static int si7006_read_result(struct si7006_private *data, u8 *buf)
+{
+	unsigned int poll_us = SI7006_NOHOLD_POLL_MIN_US;
+	int retries;
+	int  ret;
+
+	for (retries = 0; ; retries++) {
+		ret = si7006_xfer(data, NULL, 0, buf, 2);
+		if (ret == 0)
+			break;
+		if ((ret != -ENXIO && ret != -EREMOTEIO) ||
+					retries >= SI7006_NOHOLD_RETRIES)
+			return ret;
+		data->bus_stats[data->bus_mode].polls++;
+		usleep_range(poll_us, poll_us + SI7006_CONV_SLACK_US);
+		poll_us = min_t(unsigned int, poll_us * 2,
+					SI7006_NOHOLD_POLL_MAX_US);
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Run a no hold master measure
+ * @param [in] data struct si7006_private pointer
+ * @param [in] cmd measure command
+ * @param [in] conv_us max conversion time of the measure
+ * @param [out] buf 2-byte result
+ * @return 0 if success
+ * @details Sleeps on a hrtimer for exactly the max conversion time, then
+ * reads the result.
+ */
+static int si7006_measure_nohold(struct si7006_private *data, u8 cmd,
+			unsigned int conv_us, u8 *buf)
+{
+	int  ret;
+
+	/* Start the measure */
+	ret = si7006_xfer(data, &cmd, 1, NULL, 0);
+	if (ret < 0)
+		return ret;
+
+	usleep_range(conv_us, conv_us + SI7006_CONV_SLACK_US);
+
+	return si7006_read_result(data, buf);
+}
+
+/**
+ * @brief Get a temperature/humidity sample with the no hold master command
+ * @param [in] dev struct device pointer
+ * @param [in] data struct si7006_private pointer
+ * @param [out] temp_code raw temperature code
+ * @param [out] rh_code raw humidity code
+ * @return 0 if success
+ * @details Same as si7006_get_master_sample() but using the no hold master
+ * command: the sensor does not stretch the clock while it converts and
+ * NACKs its address until the result is ready. The wait comes from the
+ * conversion times of the variant at the configured resolution.
+ */
+static int si7006_get_nohold_sample(struct device *dev,
+		struct si7006_private *data, u16 *temp_code, u16 *rh_code)
+{
+	const struct si7006_variant *variant = data->variant;
+	u8 cmd;
+	u8 buf[2];
+	int  ret;
+
+	ret = si7006_measure_nohold(data,
+			SI7006_MEAS_REL_HUMIDITY_NO_MASTER_MODE,
+			si7006_rh_conv_us(data), buf);
+	if (ret < 0)
+		return ret;
+
+	*rh_code = (buf[0] << 8) | buf[1];
+
+	/* Temperature of the previous humidity measure */
+	if (variant->has_old_temp) {
+		cmd = SI7006_READ_OLD_TEMP;
+		ret = si7006_xfer(data, &cmd, 1, buf, 2);
 	} else {
-		humidity = data->humidity;
+		ret = si7006_measure_nohold(data,
+				SI7006_MEAS_TEMP_NO_MASTER_MODE,
+				variant->temp_conv_us[data->resolution], buf);
 	}
+	if (ret < 0)
+		return ret;
 
-error:
-	mutex_unlock(&data->update_lock);
-	return humidity;
+	*temp_code = (buf[0] << 8) | buf[1];
+
+	return 0;
 }
 
 /**
- * @brief HWMON function to get maximum humidity
+ * @brief Get a temperature/humidity sample with the selected bus sequencing
  * @param [in] dev struct device pointer
- * @return maximum measured temperature
- * @details The function doesn't make aby real measure, but simply returns the
- * maximum humidity read by the sensor.
+ * @param [in] data struct si7006_private pointer
+ * @param [out] temperature temperature value
+ * @param [out] humidity humidity value
+ * @return 0 if success
+ * @details Must be called with update_lock held.
+ * - SI7006_BUS_STRETCH: hold master command, the sensor stretches the clock
+ *   for the whole conversion.
+ * - SI7006_BUS_LOCK: no hold master command with the adapter locked from
+ *   command to result, no other traffic can interleave.
+ * - SI7006_BUS_RELEASE: no hold master command, the bus is free for other
+ *   devices while the sensor converts.
+ * Bus occupancy and latency of each conversion are accounted per mode, and
+ * the raw codes are logged to the relay channel when it is open.
  */
-static long si7006_get_humidity_max(struct device *dev)
+static int si7006_convert(struct device *dev, struct si7006_private *data,
+			long *temperature, long *humidity)
 {
-	struct si7006_private *data = dev_get_drvdata(dev);
+	struct si7006_bus_stats *stats = &data->bus_stats[data->bus_mode];
+	ktime_t start = ktime_get();
+	u64 busy = data->bus_busy_ns;
+	u16 temp_code = 0, rh_code = 0;
+	u64 latency;
+	int ret;
 
-	return data->max_humidity;
+	switch (data->bus_mode) {
+		case SI7006_BUS_STRETCH:
+			ret = si7006_get_master_sample(dev, data, &temp_code,
+						&rh_code);
+			break;
+		case SI7006_BUS_LOCK:
+			i2c_lock_bus(data->client->adapter, I2C_LOCK_SEGMENT);
+			data->bus_locked = true;
+			ret = si7006_get_nohold_sample(dev, data, &temp_code,
+						&rh_code);
+			data->bus_locked = false;
+			i2c_unlock_bus(data->client->adapter, I2C_LOCK_SEGMENT);
+			break;
+		default:
+			ret = si7006_get_nohold_sample(dev, data, &temp_code,
+						&rh_code);
+			break;
+	}
+
+	if (ret == 0) {
+		*temperature = si7006_raw_to_temperature(temp_code);
+		*humidity = si7006_raw_to_humidity(rh_code);
+		si7006_relay_log(data, temp_code, rh_code);
+	}
+
+	latency = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	stats->conversions++;
+	if (ret < 0)
+		stats->errors++;
+	stats->latency_ns += latency;
+	stats->max_latency_ns = max(stats->max_latency_ns, latency);
+	/* A locked adapter is unavailable to others for the whole sequence */
+	if (data->bus_mode == SI7006_BUS_LOCK)
+		stats->occupancy_ns += latency;
+	else
+		stats->occupancy_ns += data->bus_busy_ns - busy;
+
+	return ret;
 }
 
 /**
- * @brief HWMON function to get minimum humidity
+ * @brief Get an oversampled temperature/humidity sample
  * @param [in] dev struct device pointer
- * @return maximum measured temperature
- * @details The function doesn't make any real measure, but simply returns the
- * minimum humidity read by the sensor.
+ * @param [in] data struct si7006_private pointer
+ * @param [out] sample struct si7006_sample pointer
+ * @return 0 if success
+ * @details Runs oversampling_ratio back-to-back conversions and returns their
+ * mean, with the peak-to-peak spread of the burst.
+ */
+static int si7006_get_oversampled(struct device *dev,
+		struct si7006_private *data, struct si7006_sample *sample)
+{
+	long temperature, humidity;
+	long t_min = 0, t_max = 0, h_min = 0, h_max = 0;
+	long long t_sum = 0, h_sum = 0;
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < data->oversampling; i++) {
+		ret = si7006_convert(dev, data, &temperature, &humidity);
+		if (ret < 0)
+			return ret;
+
+		t_sum += temperature;
+		h_sum += humidity;
+		if (i == 0 || temperature < t_min)
+			t_min = temperature;
+		if (i == 0 || temperature > t_max)
+			t_max = temperature;
+		if (i == 0 || humidity < h_min)
+			h_min = humidity;
+		if (i == 0 || humidity > h_max)
+			h_max = humidity;
+	}
+
+	sample->temperature = (long)div_s64(t_sum, data->oversampling);
+	sample->humidity = (long)div_s64(h_sum, data->oversampling);
+	sample->temperature_spread = t_max - t_min;
+	sample->humidity_spread = h_max - h_min;
+
+	return 0;
+}
+
+/****************************************************************************
+ * PSYCHROMETRIC FUNCTIONS
+ ****************************************************************************/
+
+/* 2^(2^-i) for i = 1...16 in Q30 */
+static const u32 si7006_exp2_frac[SI7006_FP_SHIFT] = {
+	1518500250, 1276901417, 1170923762, 1121280436,
+	1097253708, 1085434106, 1079572136, 1076653033,
+	1075196443, 1074468888, 1074105294, 1073923544,
+	1073832680, 1073787251, 1073764537, 1073753181,
+};
+
+/**
+ * @brief Fixed point base 2 logarithm
+ * @param [in] x positive Q16 value
+ * @return log2(x) in Q16
+ */
+static s64 si7006_fp_log2(u64 x)
+{
+	s64 result;
+	int i, msb;
+
+	msb = fls64(x) - 1;
+	result = (s64)(msb - SI7006_FP_SHIFT) << SI7006_FP_SHIFT;
+
+	/* Normalize mantissa to [1, 2) in Q30 */
+	if (msb > 30)
+		x >>= msb - 30;
+	else
+		x <<= 30 - msb;
+
+	/* One fractional bit for each squaring */
+	for (i = SI7006_FP_SHIFT - 1; i >= 0; i--) {
+		x = (x * x) >> 30;
+		if (x >= (2ULL << 30)) {
+			x >>= 1;
+			result |= 1LL << i;
+		}
+	}
+
+	return result;
+}
+
+/**
+ * @brief Fixed point base 2 exponential
+ * @param [in] y Q16 value
+ * @return 2^y in Q16
+ */
+static u64 si7006_fp_exp2(s64 y)
+{
+	s64 ipart = y >> SI7006_FP_SHIFT;
+	u64 frac = y & (SI7006_FP_ONE - 1);
+	u64 result = 1ULL << 30;
+	int i;
+
+	for (i = 0; i < SI7006_FP_SHIFT; i++)
+		if (frac & (1ULL << (SI7006_FP_SHIFT - 1 - i)))
+			result = (result * si7006_exp2_frac[i]) >> 30;
+
+	/* Back to Q16 and apply the integer part */
+	ipart += SI7006_FP_SHIFT - 30;
+	if (ipart >= 0)
+		return result << ipart;
+	if (ipart <= -63)
+		return 0;
+	return result >> -ipart;
+}
+
+/**
+ * @brief Compute the derived channels of a sample
+ * @param [in,out] sample struct si7006_sample pointer
+ * @details Magnus formula over water (a = 17.62, b = 243.12 C), computed in
+ * Q16 fixed point from the temperature and humidity of the sample:
+ * dew point in milli celsius, absolute humidity in mg/m3 and vapour-pressure
+ * deficit in Pa.
+ */
+static void si7006_compute_derived(struct si7006_sample *sample)
+{
+	long humidity = clamp_val(sample->humidity, 100, 100000);
+	s64 t, ln_rh, m, gamma, es, e;
+
+	t = div64_s64((s64)sample->temperature << SI7006_FP_SHIFT, 1000);
+
+	/* gamma = ln(RH) + a*T/(b+T) */
+	ln_rh = (si7006_fp_log2(div64_u64((u64)humidity << SI7006_FP_SHIFT,
+				100000)) * SI7006_FP_LN2) >> SI7006_FP_SHIFT;
+	m = div64_s64(SI7006_MAGNUS_A * t, SI7006_MAGNUS_B + t);
+	gamma = ln_rh + m;
+
+	/* Td = b*gamma/(a-gamma) */
+	sample->dew_point = (long)div64_s64(SI7006_MAGNUS_B * gamma * 1000,
+				(SI7006_MAGNUS_A - gamma) << SI7006_FP_SHIFT);
+
+	/* Saturation and actual vapour pressure in Q16 Pa */
+	es = (SI7006_MAGNUS_ES0 * (s64)si7006_fp_exp2((m * SI7006_FP_LOG2E)
+				>> SI7006_FP_SHIFT)) >> SI7006_FP_SHIFT;
+	e = div64_s64(es * humidity, 100000);
+
+	sample->vpd = (long)((es - e) >> SI7006_FP_SHIFT);
+
+	/* AH = e/(Rv*T), Rv = 461.5 J/(kg K) */
+	sample->abs_humidity = (long)(div64_s64(div64_s64(e * 10000000, 4615)
+			* 1000, sample->temperature + 273150) >> SI7006_FP_SHIFT);
+}
+
+/****************************************************************************
+ * HEATER FUNCTIONS
+ ****************************************************************************/
+
+/**
+ * @brief Check if samples are biased by the heater
+ * @param [in] data struct si7006_private pointer
+ * @return true while the heater is on or the sensor is still cooling down
+ * @details Must be called with update_lock held.
+ */
+static bool si7006_heater_busy(struct si7006_private *data)
+{
+	return data->heater_enabled ||
+		time_before(jiffies, data->heater_settled);
+}
+
+/**
+ * @brief Switch the on-chip heater
+ * @param [in] data struct si7006_private pointer
+ * @param [in] enable true to switch heater on
+ * @return 0 if success
+ * @details Must be called with update_lock held. When the heater is switched
+ * off the settle window starts, samples are suppressed until it expires.
+ */
+static int si7006_heater_set(struct si7006_private *data, bool enable)
+{
+	int ret;
+
+	ret = si7006_reg_update(data, SI7006_REG_USER, SI7006_USER_HTRE,
+				enable ? SI7006_USER_HTRE : 0);
+	if (ret < 0)
+		return ret;
+
+	if (data->heater_enabled && !enable)
+		data->heater_settled = jiffies +
+				msecs_to_jiffies(SI7006_HEATER_SETTLE_MS);
+	if (data->heater_enabled != enable) {
+		data->heater_enabled = enable;
+		/* The flags of the sample page follow the heater */
+		si7006_chardev_update(data);
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Heater duty-cycle worker
+ * @param [in] work struct work_struct pointer
+ * @details Alternates heater pulses of heater_duration seconds every
+ * heater_period seconds to clear condensation from the sensor.
+ */
+static void si7006_heater_work(struct work_struct *work)
+{
+	struct si7006_private *data = container_of(to_delayed_work(work),
+					struct si7006_private, heater_work);
+	unsigned long delay;
+
+	mutex_lock(&data->update_lock);
+
+	if (!data->heater_period) {
+		/* Schedule stopped: end a pulse still in progress */
+		if (!data->heater_pulse_on)
+			goto unlock;
+		if (si7006_heater_set(data, false) == 0)
+			data->heater_pulse_on = false;
+		else
+			queue_delayed_work(data->wq, &data->heater_work,
+				msecs_to_jiffies(SI7006_HEATER_RETRY_MS));
+		goto unlock;
+	}
+
+	/* The pulse state follows the hardware: a failed switch is retried */
+	if (si7006_heater_set(data, !data->heater_pulse_on) < 0) {
+		dev_warn(&data->client->dev, "heater switch failed\n");
+		delay = msecs_to_jiffies(SI7006_HEATER_RETRY_MS);
+	} else {
+		data->heater_pulse_on = !data->heater_pulse_on;
+		if (data->heater_pulse_on)
+			delay = msecs_to_jiffies(data->heater_duration *
+						MSEC_PER_SEC);
+		else
+			delay = msecs_to_jiffies((data->heater_period -
+					data->heater_duration) * MSEC_PER_SEC);
+	}
+
+	queue_delayed_work(data->wq, &data->heater_work, delay);
+
+unlock:
+	mutex_unlock(&data->update_lock);
+}
+
+/**
+ * @brief Stop the heater schedule and switch the heater off
+ * @param [in] arg struct si7006_private pointer
+ * @details Registered as devm action so it runs after hwmon is unregistered.
+ */
+static void si7006_heater_stop(void *arg)
+{
+	struct si7006_private *data = arg;
+
+	mutex_lock(&data->update_lock);
+	data->heater_period = 0;
+	mutex_unlock(&data->update_lock);
+
+	cancel_delayed_work_sync(&data->heater_work);
+
+	mutex_lock(&data->update_lock);
+	if (data->heater_enabled)
+		si7006_heater_set(data, false);
+	mutex_unlock(&data->update_lock);
+}
+
+/**
+ * @brief Publish a new sample
+ * @param [in] data struct si7006_private pointer
+ * @param [in] sample struct si7006_sample pointer
+ * @details Must be called with update_lock held. The derived channels are
+ * computed once for each new sample, which is then stamped with its
+ * CLOCK_MONOTONIC time and sequence number and published under sample_lock
+ * for the lockless readers.
+ */
+static void si7006_publish_sample(struct si7006_private *data,
+			const struct si7006_sample *sample)
+{
+	struct si7006_sample published = *sample;
+	long temperature = sample->temperature;
+	long humidity = sample->humidity;
+
+	si7006_compute_derived(&published);
+	published.timestamp = ktime_get();
+	published.seq = data->sample.seq + 1;
+
+	write_seqlock(&data->sample_lock);
+
+	data->sample = published;
+
+	if (data->sample_valid) {
+		if (temperature>data->max_temperature)
+			data->max_temperature = temperature;
+		if (temperature<data->min_temperature)
+			data->min_temperature = temperature;
+		if (humidity>data->max_humidity)
+			data->max_humidity = humidity;
+		if (humidity<data->min_humidity)
+			data->min_humidity = humidity;
+	} else {
+		data->min_temperature = temperature;
+		data->max_temperature = temperature;
+		data->min_humidity = humidity;
+		data->max_humidity = humidity;
+		data->sample_valid = true;
+	}
+
+	write_sequnlock(&data->sample_lock);
+
+	si7006_chardev_update(data);
+	si7006_netlink_sample(data, &published);
+}
+
+/**
+ * @brief Soft reset the sensor
+ * @param [in] data struct si7006_private pointer
+ * @return 0 if success
+ * @details Must be called with update_lock held. The reset restores the
+ * default user and heater registers, the cached configuration is then
+ * written back.
+ */
+static int si7006_soft_reset(struct si7006_private *data)
+{
+	u8 cmd = SI7006_RESET;
+	int ret;
+
+	ret = si7006_xfer(data, &cmd, 1, NULL, 0);
+	if (ret < 0)
+		return ret;
+
+	msleep(SI7006_RESET_MS);
+
+	data->reset_count++;
+
+	return si7006_reg_restore(data);
+}
+
+/**
+ * @brief Check if the sensor must be left alone
+ * @param [in] data struct si7006_private pointer
+ * @return true while backing off after repeated failures
+ * @details Must be called with update_lock held.
+ */
+static bool si7006_in_backoff(struct si7006_private *data)
+{
+	return data->consecutive_errors >= SI7006_RESET_THRESHOLD &&
+		time_before(jiffies, data->backoff_until);
+}
+
+/**
+ * @brief Account the result of a measure
+ * @param [in] data struct si7006_private pointer
+ * @param [in] err result of the measure
+ * @details Must be called with update_lock held. After
+ * SI7006_RESET_THRESHOLD consecutive failures the sensor is soft reset and
+ * left alone for a backoff time that doubles at every further failure, so a
+ * broken sensor does not hammer a shared bus. The sensor is reported faulty
+ * from the first reset until a measure succeeds again.
+ */
+static void si7006_account_result(struct si7006_private *data, int err)
+{
+	data->last_error = err;
+
+	if (err == 0) {
+		data->consecutive_errors = 0;
+		data->backoff_ms = SI7006_BACKOFF_MIN_MS;
+		if (data->fault) {
+			data->fault = false;
+			si7006_chardev_update(data);
+			si7006_netlink_alarm(data, SI7006_ALARM_FAULT, false);
+		}
+		return;
+	}
+
+	data->error_count++;
+	if (++data->consecutive_errors < SI7006_RESET_THRESHOLD)
+		return;
+
+	if (!data->fault) {
+		data->fault = true;
+		si7006_chardev_update(data);
+		si7006_netlink_alarm(data, SI7006_ALARM_FAULT, true);
+	}
+
+	dev_warn_ratelimited(&data->client->dev,
+			"%u consecutive errors (%d), resetting sensor\n",
+			data->consecutive_errors, err);
+	si7006_soft_reset(data);
+
+	data->backoff_until = jiffies + msecs_to_jiffies(data->backoff_ms);
+	data->backoff_ms = min_t(unsigned int, data->backoff_ms * 2,
+				SI7006_BACKOFF_MAX_MS);
+}
+
+/**
+ * @brief Check the age of a sample
+ * @param [in] timestamp CLOCK_MONOTONIC time of the sample
+ * @param [in] max_age max age in milliseconds
+ * @return true if the sample is not older than max_age
+ */
+static bool si7006_sample_fresh(ktime_t timestamp, unsigned int max_age)
+{
+	return ktime_compare(ktime_get(), ktime_add_ms(timestamp, max_age)) <= 0;
+}
+
+/**
+ * @brief Decide whether a failed refresh can be hidden
+ * @param [in] data struct si7006_private pointer
+ * @param [in] err error of the failed refresh
+ * @return 0 when the cached sample can be served, err otherwise
+ * @details Must be called with update_lock held. The last good sample is
+ * served when it is not older than max_staleness milliseconds; its age is
+ * reported by sample_age.
+ */
+static int si7006_stale_fallback(struct si7006_private *data, int err)
+{
+	if (data->sample_valid && data->max_staleness &&
+			si7006_sample_fresh(data->sample.timestamp,
+						data->max_staleness))
+		return 0;
+
+	return err;
+}
+
+/**
+ * @brief Refresh the cached sample
+ * @param [in] dev struct device pointer
+ * @param [in] data struct si7006_private pointer
+ * @return 0 if success
+ * @details Must be called with update_lock held. The sensor is addressed only
+ * when the cached sample is older than update_interval and the background
+ * sampler is not running.
+ */
+static int si7006_update_sample(struct device *dev, struct si7006_private *data)
+{
+	struct si7006_sample sample = { 0 };
+	int ret;
+
+	/* While the heater biases the sensor serve the last sample, if recent */
+	if (si7006_heater_busy(data))
+		return si7006_stale_fallback(data, -EBUSY);
+
+	/* The background sampler keeps the sample up to date */
+	if (data->sample_valid && data->sample_interval)
+		return data->last_error ?
+			si7006_stale_fallback(data, data->last_error) : 0;
+
+	if (data->sample_valid && si7006_sample_fresh(data->sample.timestamp,
+						data->update_interval))
+		return 0;
+
+	if (si7006_in_backoff(data))
+		return si7006_stale_fallback(data, -EAGAIN);
+
+	ret = si7006_convert(dev, data, &sample.temperature, &sample.humidity);
+	si7006_account_result(data, ret);
+	if (ret < 0)
+		return si7006_stale_fallback(data, ret);
+
+	si7006_publish_sample(data, &sample);
+
+	return 0;
+}
+
+/****************************************************************************
+ * BACKGROUND SAMPLER
+ ****************************************************************************/
+
+/**
+ * @brief Adapt the sampling interval to the signal dynamics
+ * @param [in] data struct si7006_private pointer
+ * @param [in] sample struct si7006_sample pointer of the new sample
+ * @details Must be called with update_lock held, before the new sample is
+ * published. When temperature or humidity changed more than the threshold
+ * since the previous sample the interval is halved, otherwise it is relaxed
+ * by a quarter, always within sample_interval_min and sample_interval_max.
+ */
+static void si7006_adapt_interval(struct si7006_private *data,
+			const struct si7006_sample *sample)
+{
+	unsigned int interval = data->cur_interval;
+	bool moving;
+
+	if (!data->sample_valid)
+		return;
+
+	moving = abs(sample->temperature - data->sample.temperature) >
+						data->threshold_temperature ||
+		 abs(sample->humidity - data->sample.humidity) >
+						data->threshold_humidity;
+
+	if (moving)
+		interval /= 2;
+	else
+		interval += interval / 4 + 1;
+
+	data->cur_interval = clamp_val(interval, data->interval_min,
+				data->interval_max);
+}
+
+/**
+ * @brief Delay before the next background sample
+ * @param [in] data struct si7006_private pointer
+ * @return delay in milliseconds
+ * @details Must be called with update_lock held. With a freshness contract
+ * active the next sample must be published before the current one is older
+ * than the contract, so the delay is shortened by the duration of an
+ * oversampled conversion (keeping at least half of the contract).
+ */
+static unsigned int si7006_sampler_delay(struct si7006_private *data)
+{
+	const struct si7006_variant *variant = data->variant;
+	unsigned int contract = data->contract_age;
+	unsigned int delay = UINT_MAX;
+	unsigned int conv_ms;
+
+	if (data->sample_interval)
+		delay = data->cur_interval;
+	if (!contract)
+		return delay;
+
+	conv_ms = DIV_ROUND_UP((variant->rh_conv_us[data->resolution] +
+			variant->temp_conv_us[data->resolution]) *
+			data->oversampling, USEC_PER_MSEC);
+	if (contract > 2 * conv_ms)
+		contract -= conv_ms;
+	else
+		contract /= 2;
+
+	return min(delay, max(contract, 1U));
+}
+
+/**
+ * @brief Queue the background sampler
+ * @param [in] data struct si7006_private pointer
+ * @param [in] delay delay in milliseconds, 0 to sample now
+ * @details Must be called with update_lock held. The sampler runs on the
+ * unbound workqueue of the sensor with a deferrable timer: an idle CPU is
+ * not woken up for it, the sample is taken at its next wakeup instead.
+ */
+static void si7006_sampler_queue(struct si7006_private *data,
+			unsigned int delay)
+{
+	data->sample_due = ktime_add_ms(ktime_get(), delay);
+	mod_delayed_work(data->wq, &data->sample_work, msecs_to_jiffies(delay));
+}
+
+/**
+ * @brief Account a background sampler wakeup
+ * @param [in] data struct si7006_private pointer
+ * @param [in] due time the sample was due
+ * @details Must be called with update_lock held. The lateness includes the
+ * timer wheel granularity and the deferral to the next CPU wakeup.
+ */
+static void si7006_sampler_account(struct si7006_private *data, ktime_t due)
+{
+	struct si7006_sampler_stats *stats = &data->sampler_stats;
+	s64 late = ktime_to_ns(ktime_sub(ktime_get(), due));
+
+	if (late < 0)
+		late = 0;
+
+	stats->runs++;
+	stats->late_ns += late;
+	stats->max_late_ns = max_t(u64, stats->max_late_ns, late);
+	stats->cpu = raw_smp_processor_id();
+}
+
+/**
+ * @brief Background sampler worker
+ * @param [in] work struct work_struct pointer
+ * @details Publishes a new oversampled sample, unless the heater is biasing
+ * the sensor, then reschedules itself after sample_interval milliseconds or
+ * after the adapted interval when the adaptive policy is selected. The
+ * sampler also runs, or runs faster, to honour the freshness contracts of
+ * the character device files.
+ */
+static void si7006_sample_work(struct work_struct *work)
+{
+	struct si7006_private *data = container_of(to_delayed_work(work),
+					struct si7006_private, sample_work);
+	struct device *dev = &data->client->dev;
+	struct si7006_sample sample = { 0 };
+	int ret;
+
+	mutex_lock(&data->update_lock);
+
+	if (!data->sample_interval && !data->contract_age)
+		goto unlock;
+
+	/* The adapter group samples this sensor together with the others */
+	if (data->group_sampling) {
+		data->group_due = data->sample_due;
+		si7006_group_kick(data);
+		goto unlock;
+	}
+
+	si7006_sampler_account(data, data->sample_due);
+
+	if (data->sample_policy == SI7006_POLICY_FIXED)
+		data->cur_interval = data->sample_interval;
+
+	if (!si7006_heater_busy(data) && !si7006_in_backoff(data)) {
+		ret = si7006_get_oversampled(dev, data, &sample);
+		si7006_account_result(data, ret);
+		if (ret == 0) {
+			if (data->sample_policy == SI7006_POLICY_ADAPTIVE)
+				si7006_adapt_interval(data, &sample);
+			si7006_publish_sample(data, &sample);
+		}
+	}
+
+	si7006_sampler_queue(data, si7006_sampler_delay(data));
+
+unlock:
+	mutex_unlock(&data->update_lock);
+}
+
+/**
+ * @brief Stop the background sampler and pending refreshes
+ * @param [in] arg struct si7006_private pointer
+ * @details Registered as devm action so it runs after hwmon is unregistered.
+ */
+static void si7006_sampler_stop(void *arg)
+{
+	struct si7006_private *data = arg;
+
+	mutex_lock(&data->update_lock);
+	data->sample_interval = 0;
+	data->contract_age = 0;
+	mutex_unlock(&data->update_lock);
+
+	cancel_delayed_work_sync(&data->sample_work);
+	cancel_work_sync(&data->hwmon_flight.work);
+	cancel_work_sync(&data->contract_flight.work);
+}
+
+/****************************************************************************
+ * COORDINATED SAMPLING
+ ****************************************************************************/
+
+/**
+ * @brief Check whether a sensor takes part in the group rounds
+ * @param [in] data struct si7006_private pointer
+ * @return true if the group samples the sensor
+ */
+static bool si7006_group_member(struct si7006_private *data)
+{
+	return READ_ONCE(data->group_sampling) &&
+		(READ_ONCE(data->sample_interval) ||
+		 READ_ONCE(data->contract_age));
+}
+
+/**
+ * @brief Run a coordinated sampling round on an adapter
+ * @param [in] group struct si7006_group pointer
+ * @return delay in ms before the next round, 0 when no member samples
+ * @details Called by the group worker with group->lock held. The no hold
+ * humidity measure is started back to back on every member that is due,
+ * then all the results are collected after a single conversion time, so N
+ * sensors cost about one conversion instead of N. Variants without the
+ * read temperature command get a second coordinated phase for the
+ * temperature. The messages go through the adapter of each sensor, so mux
+ * channels are switched as needed and sensors with the same address behind
+ * different channels are told apart. The members of the round are locked,
+ * in list order, for the whole round.
+ */
+unsigned int si7006_group_round(struct si7006_group *group)
+{
+	struct si7006_private *data, *tmp;
+	struct si7006_sample sample;
+	ktime_t window = ktime_add_ms(ktime_get(), SI7006_GROUP_WINDOW_MS);
+	unsigned int conv_us = 0;
+	unsigned int temp_us = 0;
+	s64 next = S64_MAX;
+	LIST_HEAD(round);
+	u8 buf[2];
+	u8 cmd;
+
+	/* Start the humidity measure of the members that are due */
+	list_for_each_entry(data, &group->members, group_node) {
+		if (!si7006_group_member(data) ||
+				ktime_after(data->group_due, window))
+			continue;
+
+		mutex_lock_nest_lock(&data->update_lock, &group->lock);
+
+		if (data->sample_policy == SI7006_POLICY_FIXED)
+			data->cur_interval = data->sample_interval;
+
+		if (si7006_heater_busy(data) || si7006_in_backoff(data)) {
+			data->group_due = ktime_add_ms(ktime_get(),
+						si7006_sampler_delay(data));
+			mutex_unlock(&data->update_lock);
+			continue;
+		}
+
+		si7006_sampler_account(data, data->group_due);
+
+		cmd = SI7006_MEAS_REL_HUMIDITY_NO_MASTER_MODE;
+		data->round_ret = si7006_xfer(data, &cmd, 1, NULL, 0);
+		data->round_temp_pending = false;
+		if (data->round_ret == 0)
+			conv_us = max(conv_us, si7006_rh_conv_us(data));
+		list_add_tail(&data->round_node, &round);
+	}
+
+	if (list_empty(&round))
+		goto out;
+
+	usleep_range(conv_us, conv_us + SI7006_CONV_SLACK_US);
+
+	/* Collect the humidity, then the temperature or start its measure */
+	list_for_each_entry(data, &round, round_node) {
+		if (data->round_ret)
+			continue;
+		data->round_ret = si7006_read_result(data, buf);
+		if (data->round_ret)
+			continue;
+		data->round_rh_code = (buf[0] << 8) | buf[1];
+
+		if (data->variant->has_old_temp) {
+			cmd = SI7006_READ_OLD_TEMP;
+			data->round_ret = si7006_xfer(data, &cmd, 1, buf, 2);
+			data->round_temp_code = (buf[0] << 8) | buf[1];
+		} else {
+			cmd = SI7006_MEAS_TEMP_NO_MASTER_MODE;
+			data->round_ret = si7006_xfer(data, &cmd, 1, NULL, 0);
+			data->round_temp_pending = true;
+			temp_us = max(temp_us,
+				data->variant->temp_conv_us[data->resolution]);
+		}
+	}
+
+	if (temp_us) {
+		usleep_range(temp_us, temp_us + SI7006_CONV_SLACK_US);
+
+		list_for_each_entry(data, &round, round_node) {
+			if (data->round_ret || !data->round_temp_pending)
+				continue;
+			data->round_ret = si7006_read_result(data, buf);
+			data->round_temp_code = (buf[0] << 8) | buf[1];
+		}
+	}
+
+	/* Publish the samples and release the members */
+	list_for_each_entry_safe(data, tmp, &round, round_node) {
+		list_del(&data->round_node);
+
+		si7006_account_result(data, data->round_ret);
+		if (data->round_ret == 0) {
+			memset(&sample, 0, sizeof(sample));
+			sample.temperature =
+				si7006_raw_to_temperature(data->round_temp_code);
+			sample.humidity =
+				si7006_raw_to_humidity(data->round_rh_code);
+			si7006_relay_log(data, data->round_temp_code,
+						data->round_rh_code);
+			if (data->sample_policy == SI7006_POLICY_ADAPTIVE)
+				si7006_adapt_interval(data, &sample);
+			si7006_publish_sample(data, &sample);
+		}
+
+		data->group_due = ktime_add_ms(ktime_get(),
+					si7006_sampler_delay(data));
+		mutex_unlock(&data->update_lock);
+	}
+
+out:
+	/* Next round when the first member is due */
+	list_for_each_entry(data, &group->members, group_node) {
+		if (si7006_group_member(data))
+			next = min(next, max_t(s64, 1,
+				ktime_ms_delta(data->group_due, ktime_get())));
+	}
+
+	return next == S64_MAX ? 0 : next;
+}
+
+/**
+ * @brief Refresh the sample for a freshness contract
+ * @param [in] data struct si7006_private pointer
+ * @param [in] max_age max sample age in milliseconds
+ * @return 0 if success
+ * @details Must be called with update_lock held. Unlike the hwmon refresh
+ * the contract is never relaxed: while the heater biases the sensor the
+ * refresh fails with EBUSY, during backoff with EAGAIN.
+ */
+static int si7006_refresh_contract(struct si7006_private *data,
+			unsigned int max_age)
+{
+	struct si7006_sample fresh = { 0 };
+	int ret;
+
+	if (data->sample_valid &&
+			si7006_sample_fresh(data->sample.timestamp, max_age))
+		return 0;
+
+	if (si7006_heater_busy(data))
+		return -EBUSY;
+	if (si7006_in_backoff(data))
+		return -EAGAIN;
+
+	ret = si7006_get_oversampled(&data->client->dev, data, &fresh);
+	si7006_account_result(data, ret);
+	if (ret < 0)
+		return ret;
+
+	si7006_publish_sample(data, &fresh);
+
+	return 0;
+}
+
+/**
+ * @brief Asynchronous refresh worker
+ * @param [in] work struct work_struct pointer
+ * @details Runs the refresh in flight on behalf of its readers, then hands
+ * its result to all of them at once. A contract refresh honours the
+ * strictest age requested before it started.
+ */
+static void si7006_flight_work(struct work_struct *work)
+{
+	struct si7006_flight *flight = container_of(work,
+					struct si7006_flight, work);
+	struct si7006_private *data = flight->data;
+	unsigned int max_age;
+	int ret;
+
+	spin_lock(&data->flight_lock);
+	max_age = flight->max_age;
+	flight->max_age = 0;
+	spin_unlock(&data->flight_lock);
+
+	mutex_lock(&data->update_lock);
+	if (flight == &data->contract_flight)
+		ret = si7006_refresh_contract(data, max_age);
+	else
+		ret = si7006_update_sample(&data->client->dev, data);
+	mutex_unlock(&data->update_lock);
+
+	spin_lock(&data->flight_lock);
+	flight->ret = ret;
+	flight->gen++;
+	flight->in_flight = false;
+	spin_unlock(&data->flight_lock);
+
+	wake_up_all(&data->flight_wq);
+}
+
+/**
+ * @brief Start a refresh, or join the one in flight
+ * @param [in] data struct si7006_private pointer
+ * @param [in] flight struct si7006_flight pointer
+ * @param [in] max_age max sample age in milliseconds, 0 for the hwmon one
+ * @return generation of the refresh in flight
+ * @details The refresh completes when the generation of the flight moves
+ * past the returned one.
+ */
+static u64 si7006_refresh_start(struct si7006_private *data,
+			struct si7006_flight *flight, unsigned int max_age)
+{
+	u64 gen;
+
+	spin_lock(&data->flight_lock);
+	if (max_age && (!flight->max_age || max_age < flight->max_age))
+		flight->max_age = max_age;
+	if (flight->in_flight) {
+		flight->coalesced++;
+	} else {
+		flight->in_flight = true;
+		flight->refreshes++;
+		queue_work(data->wq, &flight->work);
+	}
+	gen = flight->gen;
+	spin_unlock(&data->flight_lock);
+
+	return gen;
+}
+
+/**
+ * @brief Wait for a refresh of the sample
+ * @param [in] data struct si7006_private pointer
+ * @param [in] flight struct si7006_flight pointer
+ * @param [in] max_age max sample age in milliseconds, 0 for the hwmon one
+ * @param [in] timeout max wait in jiffies
+ * @return result of the refresh, ETIMEDOUT if it didn't end in time
+ * @details Concurrent readers share one refresh. Readers never sleep on
+ * update_lock: they wait on flight_wq, killable and bounded, so a hung bus
+ * can't leave them in D state.
+ */
+static int si7006_refresh_wait(struct si7006_private *data,
+			struct si7006_flight *flight, unsigned int max_age,
+			long timeout)
+{
+	u64 gen = si7006_refresh_start(data, flight, max_age);
+	long left;
+	int ret;
+
+	left = wait_event_killable_timeout(data->flight_wq,
+			READ_ONCE(flight->gen) != gen, timeout);
+	if (left < 0)
+		return left;
+
+	spin_lock(&data->flight_lock);
+	if (left == 0) {
+		flight->timeouts++;
+		ret = -ETIMEDOUT;
+	} else {
+		ret = flight->ret;
+	}
+	spin_unlock(&data->flight_lock);
+
+	return ret;
+}
+
+/**
+ * @brief Get a sample value without taking update_lock
+ * @param [in] data struct si7006_private pointer
+ * @param [in] offset offset of the value inside struct si7006_sample
+ * @param [out] val value
+ * @return true if the cached value can be served
+ * @details A sample not older than update_interval is always served. With
+ * stale_while_revalidate set, an older sample is served too as long as it is
+ * not older than stale_while_revalidate milliseconds, and a refresh is queued
+ * so the reader never waits for a conversion.
+ */
+static bool si7006_get_cached_value(struct si7006_private *data,
+			size_t offset, long *val)
+{
+	ktime_t updated;
+	unsigned int seq;
+	bool valid;
+
+	do {
+		seq = read_seqbegin(&data->sample_lock);
+		valid = data->sample_valid;
+		updated = data->sample.timestamp;
+		*val = *(long *)((char *)&data->sample + offset);
+	} while (read_seqretry(&data->sample_lock, seq));
+
+	if (!valid)
+		return false;
+
+	if (si7006_sample_fresh(updated, READ_ONCE(data->update_interval)))
+		return true;
+
+	if (!data->swr_max_age ||
+			!si7006_sample_fresh(updated, data->swr_max_age))
+		return false;
+
+	si7006_refresh_start(data, &data->hwmon_flight, 0);
+	return true;
+}
+
+/**
+ * @brief Get the status flags of the sample
+ * @param [in] data struct si7006_private pointer
+ * @return SI7006_FLAG_* mask
+ */
+u32 si7006_status_flags(struct si7006_private *data)
+{
+	u32 flags = 0;
+
+	if (data->sample_valid)
+		flags |= SI7006_FLAG_VALID;
+	if (READ_ONCE(data->fault))
+		flags |= SI7006_FLAG_FAULT;
+	if (READ_ONCE(data->heater_enabled))
+		flags |= SI7006_FLAG_HEATER;
+
+	return flags;
+}
+
+/**
+ * @brief Set the strictest freshness contract
+ * @param [in] data struct si7006_private pointer
+ * @param [in] max_age max sample age in milliseconds, 0 if none
+ * @details Called by the character device when the contracts of its open
+ * files change. The background sampler is restarted to follow the contract.
+ */
+void si7006_set_contract(struct si7006_private *data, unsigned int max_age)
+{
+	mutex_lock(&data->update_lock);
+	data->contract_age = max_age;
+	if (max_age)
+		si7006_sampler_queue(data, 0);
+	mutex_unlock(&data->update_lock);
+}
+
+/**
+ * @brief Get a sample not older than a given age
+ * @param [in] data struct si7006_private pointer
+ * @param [in] max_age max sample age in milliseconds, 0 for update_interval
+ * @param [out] sample struct si7006_sample pointer
+ * @param [out] flags SI7006_FLAG_* mask of the sample
+ * @return 0 if success
+ * @details A conversion is run when the cached sample is too old, shared by
+ * the concurrent contract readers. Unlike the hwmon attributes the contract
+ * is never relaxed: while the heater biases the sensor the call fails with
+ * EBUSY, during backoff with EAGAIN, and with ETIMEDOUT when no fresh
+ * enough sample comes within SI7006_READ_TIMEOUT_MS.
+ */
+int si7006_read_fresh(struct si7006_private *data, unsigned int max_age,
+			struct si7006_sample *sample, u32 *flags)
+{
+	unsigned long deadline = jiffies +
+				msecs_to_jiffies(SI7006_READ_TIMEOUT_MS);
+	unsigned int seq;
+	bool valid;
+	int ret;
+
+	if (!max_age)
+		max_age = READ_ONCE(data->update_interval);
+
+	for (;;) {
+		do {
+			seq = read_seqbegin(&data->sample_lock);
+			valid = data->sample_valid;
+			*sample = data->sample;
+		} while (read_seqretry(&data->sample_lock, seq));
+
+		if (valid && si7006_sample_fresh(sample->timestamp, max_age))
+			break;
+
+		/* A refresh started earlier may follow a looser contract */
+		if (time_after_eq(jiffies, deadline))
+			return -ETIMEDOUT;
+		ret = si7006_refresh_wait(data, &data->contract_flight,
+					max_age, deadline - jiffies);
+		if (ret < 0)
+			return ret;
+	}
+
+	*flags = si7006_status_flags(data);
+
+	return 0;
+}
+
+/**
+ * @brief HWMON function to get a sample value
+ * @param [in] dev struct device pointer
+ * @param [in] offset offset of the value inside struct si7006_sample
+ * @param [out] val value
+ * @return 0 if success
+ * @details Returns one value of the current sample and avoid to address
+ * sensor when measure are made close in time. Readers finding an expired
+ * sample wait for the refresh in flight.
+ */
+static int si7006_get_sample_value(struct device *dev, size_t offset,
+			long *val)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+	unsigned int staleness = READ_ONCE(data->max_staleness);
+	ktime_t updated;
+	unsigned int seq;
+	bool valid;
+	int ret;
+
+	if (si7006_get_cached_value(data, offset, val))
+		return 0;
+
+	ret = si7006_refresh_wait(data, &data->hwmon_flight, 0,
+				msecs_to_jiffies(SI7006_READ_TIMEOUT_MS));
+	if (ret < 0 && ret != -ETIMEDOUT)
+		return ret;
+
+	do {
+		seq = read_seqbegin(&data->sample_lock);
+		valid = data->sample_valid;
+		updated = data->sample.timestamp;
+		*val = *(long *)((char *)&data->sample + offset);
+	} while (read_seqretry(&data->sample_lock, seq));
+
+	/* A timed out refresh is hidden like a failed one, within max_staleness */
+	if (ret == -ETIMEDOUT && !(valid && staleness &&
+			si7006_sample_fresh(updated, staleness)))
+		return ret;
+
+	return 0;
+}
+
+/**
+ * @brief HWMON function to get temperature
+ * @param [in] dev struct device pointer
+ * @param [out] val temperature in milli celsius
+ * @return 0 if success
+ */
+static int si7006_get_temperature(struct device *dev, long *val)
+{
+	return si7006_get_sample_value(dev,
+				offsetof(struct si7006_sample, temperature), val);
+}
+
+/**
+ * @brief HWMON function to get dew point
+ * @param [in] dev struct device pointer
+ * @param [out] val dew point in milli celsius
+ * @return 0 if success
+ */
+static int si7006_get_dew_point(struct device *dev, long *val)
+{
+	return si7006_get_sample_value(dev,
+				offsetof(struct si7006_sample, dew_point), val);
+}
+
+/**
+ * @brief HWMON function to get maximum temperature
+ * @param [in] dev struct device pointer
+ * @return maximum measured temperature
+ * @details The function doesn't make any real measure, but simply returns the
+ * maximum temperature read by the sensor.
+ */
+static long si7006_get_temperature_max(struct device *dev)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+
+	return data->max_temperature;
+}
+
+/**
+ * @brief HWMON function to get minimum temperature
+ * @param [in] dev struct device pointer
+ * @return maximum measured temperature
+ * @details The function doesn't make any real measure, but simply returns the
+ * minimum temperature read by the sensor.
+ */
+static long si7006_get_temperature_min(struct device *dev)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+
+	return data->min_temperature;
+}
+
+/**
+ * @brief HWMON function to get humidity
+ * @param [in] dev struct device pointer
+ * @param [out] val humidity in milli %HR
+ * @return 0 if success
+ */
+static int si7006_get_humidity(struct device *dev, long *val)
+{
+	return si7006_get_sample_value(dev,
+				offsetof(struct si7006_sample, humidity), val);
+}
+
+/**
+ * @brief HWMON function to get maximum humidity
+ * @param [in] dev struct device pointer
+ * @return maximum measured temperature
+ * @details The function doesn't make aby real measure, but simply returns the
+ * maximum humidity read by the sensor.
+ */
+static long si7006_get_humidity_max(struct device *dev)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+
+	return data->max_humidity;
+}
+
+/**
+ * @brief HWMON function to get minimum humidity
+ * @param [in] dev struct device pointer
+ * @return maximum measured temperature
+ * @details The function doesn't make any real measure, but simply returns the
+ * minimum humidity read by the sensor.
+ */
+static long si7006_get_humidity_min(struct device *dev)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+
+	return data->min_humidity;
+}
+
+/**
+ * @brief HWMON function to get sensor fault state
+ * @param [in] dev struct device pointer
+ * @return 1 if the sensor is not answering
+ * @details The sensor is faulty after repeated failed measures, until a
+ * measure succeeds again.
+ */
+static long si7006_get_fault(struct device *dev)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+
+	return READ_ONCE(data->fault);
+}
+
+/**
+ * @brief HWMON temperature read method
+ * @param [in] dev struct device pointer
+ * @param [in] attr attribute
+ * @param [in] channel
+ * @param [out] val pointer
+ * @return 0 if success
+ * @details Select what temperature is requested (current/max/min)
+ * and return it.
+ */
+static int si7006_read_temperature(struct device *dev, u32 attr,
+			int channel, long *val)
+{
+	switch (attr) {
+		case hwmon_temp_input:
+			if (channel == SI7006_CH_DEW_POINT)
+				return si7006_get_dew_point(dev, val);
+			else if (channel == SI7006_CH_BOARD)
+				return si7006_get_temperature(dev, val);
+			else
+				return -EOPNOTSUPP;
+		case hwmon_temp_max:
+				if (channel == SI7006_CH_BOARD)
+					*val = si7006_get_temperature_max(dev);
+				else
+					return -EOPNOTSUPP;
+				return 0;
+		case hwmon_temp_min:
+				if (channel == SI7006_CH_BOARD)
+					*val = si7006_get_temperature_min(dev);
+				else
+					return -EOPNOTSUPP;
+				return 0;
+		case hwmon_temp_fault:
+				*val = si7006_get_fault(dev);
+				return 0;
+		default:
+			return -EOPNOTSUPP;
+	}
+}
+
+/**
+ * @brief HWMON humidity read method
+ * @param [in] dev struct device pointer
+ * @param [in] attr attribute
+ * @param [in] channel
+ * @param [out] val pointer
+ * @return 0 if success
+ * @details Select what humidity is requested (current/max/min)
+ * and return it.
+ */
+static int si7006_read_humidity(struct device *dev, u32 attr,
+			int channel, long *val)
+{
+	switch (attr) {
+		case hwmon_humidity_input:
+			if (channel < SI7006_NUM_CH_HUMIDITY)
+				return si7006_get_humidity(dev, val);
+			else
+				return -EOPNOTSUPP;
+		case hwmon_humidity_max:
+				if (channel < SI7006_NUM_CH_HUMIDITY)
+					*val = si7006_get_humidity_max(dev);
+				else
+					return -EOPNOTSUPP;
+				return 0;
+		case hwmon_humidity_min:
+				if (channel < SI7006_NUM_CH_HUMIDITY)
+					*val = si7006_get_humidity_min(dev);
+				else
+					return -EOPNOTSUPP;
+				return 0;
+		case hwmon_humidity_fault:
+				*val = si7006_get_fault(dev);
+				return 0;
+		default:
+			return -EOPNOTSUPP;
+	}
+}
+
+/**
+ * @brief HWMON chip read method
+ * @param [in] dev struct device pointer
+ * @param [in] attr attribute
+ * @param [out] val pointer
+ * @return 0 if success
+ */
+static int si7006_read_chip(struct device *dev, u32 attr, long *val)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+
+	switch (attr) {
+		case hwmon_chip_update_interval:
+			*val = data->update_interval;
+			return 0;
+		default:
+			return -EOPNOTSUPP;
+	}
+}
+
+/* HWMON input read ops */
+/**
+ * @brief HWMON Si7006 read method
+ * @param [in] dev struct device pointer
+ * @param [in] type struct hwmon_sensor_types pointer
+ * @param [in] attr attribute
+ * @param [in] channel
+ * @param [out] val pointer
+ * @return 0 if success
+ * @details Select between temperature and humidity and run the measure.
+ */
+static int si7006_read(struct device *dev, enum hwmon_sensor_types type,
+			u32 attr, int channel, long *val)
+{
+	switch (type) {
+		case hwmon_chip:
+			return si7006_read_chip(dev, attr, val);
+		case hwmon_temp:
+			return si7006_read_temperature(dev, attr, channel, val);
+		case hwmon_humidity:
+			return si7006_read_humidity(dev, attr, channel, val);
+		default:
+			return -EOPNOTSUPP;
+	}
+}
+
+/**
+ * @brief HWMON Si7006 write method
+ * @param [in] dev struct device pointer
+ * @param [in] type struct hwmon_sensor_types pointer
+ * @param [in] attr attribute
+ * @param [in] channel
+ * @param [in] val value
+ * @return 0 if success
+ * @details update_interval is the max age in milliseconds of a cached
+ * sample served without a new conversion, clamped to 1...60000.
+ */
+static int si7006_write(struct device *dev, enum hwmon_sensor_types type,
+			u32 attr, int channel, long val)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+
+	if (type != hwmon_chip || attr != hwmon_chip_update_interval)
+		return -EOPNOTSUPP;
+
+	WRITE_ONCE(data->update_interval, clamp_val(val,
+				SI7006_MIN_UPDATE_INTERVAL_MS,
+				SI7006_MAX_UPDATE_INTERVAL_MS));
+
+	return 0;
+}
+
+/**
+ * @brief HWMON function return channel name
+ * @param [in] dev struct device pointer
+ * @param [in] type enum hwmon_sensor_types
+ * @param [in] attr attribute
+ * @param [in] channel
+ * @param [out] str string pointer
+ * @return 0 if success.
+ * @details Return the label of channel.
+ */
+static int si7006_read_string(struct device *dev, enum hwmon_sensor_types type,
+		       u32 attr, int channel, const char **str)
+{
+	switch (type) {
+		case hwmon_temp:
+			if (channel == SI7006_CH_DEW_POINT)
+				*str = "DEW POINT";
+			else
+				*str = "BOARD TEMP";
+			return 0;
+		case hwmon_humidity:
+			*str = "BOARD HR";
+			return 0;
+		default:
+			return -EOPNOTSUPP;
+	}
+	return -EOPNOTSUPP;
+}
+
+/**
+ * @brief HWMON function return access attribute
+ * @param [in] data unused
+ * @param [in] type enum hwmon_sensor_types
+ * @param [in] attr attribute
+ * @param [in] channel
+ * @return permission.
+ * @details Returns file access permission
+ */
+static umode_t si7006_is_visible(const void *data, enum hwmon_sensor_types type,
+			u32 attr, int channel)
+{
+	switch (type) {
+		case hwmon_chip:
+			if (attr == hwmon_chip_update_interval)
+				return S_IRUGO | S_IWUSR;
+			break;
+		case hwmon_temp:
+			switch (attr) {
+				case hwmon_temp_input:
+				case hwmon_temp_label:
+				case hwmon_temp_max:
+				case hwmon_temp_min:
+				case hwmon_temp_fault:
+					return S_IRUGO;
+				default:
+					break;
+			}
+			break;
+		case hwmon_humidity:
+			switch (attr) {
+				case hwmon_humidity_input:
+				case hwmon_humidity_label:
+				case hwmon_humidity_max:
+				case hwmon_humidity_min:
+				case hwmon_humidity_fault:
+					return S_IRUGO;
+				default:
+					break;
+			}
+			break;
+		default:
+			break;
+	}
+	return 0;
+}
+
+/****************************************************************************
+ * SYSFS ATTRIBUTES
+ ****************************************************************************/
+
+static ssize_t heater_enable_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%d\n", data->heater_enabled);
+}
+
+static ssize_t heater_enable_store(struct device *dev,
+			struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+	bool enable;
+	int ret;
+
+	ret = kstrtobool(buf, &enable);
+	if (ret < 0)
+		return ret;
+
+	mutex_lock(&data->update_lock);
+	ret = si7006_heater_set(data, enable);
+	mutex_unlock(&data->update_lock);
+
+	return ret < 0 ? ret : count;
+}
+
+static ssize_t heater_level_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", data->heater_level);
+}
+
+static ssize_t heater_level_store(struct device *dev,
+			struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+	u8 level;
+	int ret;
+
+	ret = kstrtou8(buf, 10, &level);
+	if (ret < 0)
+		return ret;
+	if (level > SI7006_HEATER_MAX_LEVEL)
+		return -EINVAL;
+
+	mutex_lock(&data->update_lock);
+	ret = si7006_reg_update(data, SI7006_REG_HEATER, SI7006_HEATER_MASK,
+				level);
+	if (ret == 0)
+		data->heater_level = level;
+	mutex_unlock(&data->update_lock);
+
+	return ret < 0 ? ret : count;
+}
+
+static ssize_t heater_current_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", SI7006_HEATER_BASE_UA +
+				data->heater_level * SI7006_HEATER_STEP_UA);
+}
+
+static ssize_t heater_busy_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+	bool busy;
+	int ret;
+
+	/* The lock is held across conversions: don't wait for a hung bus */
+	ret = mutex_lock_killable(&data->update_lock);
+	if (ret)
+		return ret;
+	busy = si7006_heater_busy(data);
+	mutex_unlock(&data->update_lock);
+
+	return sprintf(buf, "%d\n", busy);
+}
+
+/**
+ * @brief Check a heater schedule
+ * @param [in] period seconds between heater pulses
+ * @param [in] duration length of each heater pulse in seconds
+ * @return true if the schedule can be used
+ * @details The heater must stay off long enough for the sensor to settle,
+ * or no sample would ever be taken again.
+ */
+static bool si7006_heater_schedule_valid(unsigned int period,
+			unsigned int duration)
+{
+	return duration && duration < period &&
+		(period - duration) * MSEC_PER_SEC >= SI7006_HEATER_SETTLE_MS;
+}
+
+static ssize_t heater_pulse_period_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", data->heater_period);
+}
+
+static ssize_t heater_pulse_period_store(struct device *dev,
+			struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+	unsigned int period;
+	int ret;
+
+	ret = kstrtouint(buf, 10, &period);
+	if (ret < 0)
+		return ret;
+	if (period > SI7006_HEATER_MAX_PERIOD_S)
+		return -EINVAL;
+
+	mutex_lock(&data->update_lock);
+	if (period && !si7006_heater_schedule_valid(period,
+				data->heater_duration)) {
+		mutex_unlock(&data->update_lock);
+		return -EINVAL;
+	}
+	data->heater_period = period;
+	mutex_unlock(&data->update_lock);
+
+	/* Restart the schedule, or let the worker switch the heater off */
+	mod_delayed_work(data->wq, &data->heater_work, 0);
+
+	return count;
+}
+
+static ssize_t heater_pulse_duration_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", data->heater_duration);
+}
+
+static ssize_t heater_pulse_duration_store(struct device *dev,
+			struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+	unsigned int duration;
+	int ret;
+
+	ret = kstrtouint(buf, 10, &duration);
+	if (ret < 0)
+		return ret;
+	if (duration >= SI7006_HEATER_MAX_PERIOD_S)
+		return -EINVAL;
+
+	mutex_lock(&data->update_lock);
+	if (data->heater_period && !si7006_heater_schedule_valid(
+				data->heater_period, duration)) {
+		mutex_unlock(&data->update_lock);
+		return -EINVAL;
+	}
+	data->heater_duration = duration;
+	mutex_unlock(&data->update_lock);
+
+	return count;
+}
+
+static ssize_t si7006_show_sample_value(struct device *dev, char *buf,
+			size_t offset)
+{
+	long val;
+	int ret;
+
+	ret = si7006_get_sample_value(dev, offset, &val);
+	if (ret < 0)
+		return ret;
+
+	return sprintf(buf, "%ld\n", val);
+}
+
+static ssize_t snapshot_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+	struct si7006_sample sample;
+	long t_min, t_max, h_min, h_max;
+	unsigned int seq;
+	u32 flags;
+	long val;
+	int ret;
+
+	/* Refresh the sample as a temp1_input read would */
+	ret = si7006_get_sample_value(dev,
+				offsetof(struct si7006_sample, temperature), &val);
+	if (ret < 0)
+		return ret;
+
+	do {
+		seq = read_seqbegin(&data->sample_lock);
+		sample = data->sample;
+		t_min = data->min_temperature;
+		t_max = data->max_temperature;
+		h_min = data->min_humidity;
+		h_max = data->max_humidity;
+		flags = si7006_status_flags(data);
+	} while (read_seqretry(&data->sample_lock, seq));
+
+	return sprintf(buf, "%llu %lld %ld %ld %ld %ld %ld %ld %ld 0x%x\n",
+			sample.seq, ktime_to_ns(sample.timestamp),
+			sample.temperature, sample.humidity, t_min, t_max,
+			h_min, h_max, sample.dew_point, flags);
+}
+
+static ssize_t absolute_humidity_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	return si7006_show_sample_value(dev, buf,
+				offsetof(struct si7006_sample, abs_humidity));
+}
+
+static ssize_t vapour_pressure_deficit_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	return si7006_show_sample_value(dev, buf,
+				offsetof(struct si7006_sample, vpd));
+}
+
+static ssize_t temperature_spread_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	return si7006_show_sample_value(dev, buf,
+				offsetof(struct si7006_sample, temperature_spread));
+}
+
+static ssize_t humidity_spread_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	return si7006_show_sample_value(dev, buf,
+				offsetof(struct si7006_sample, humidity_spread));
+}
+
+static ssize_t oversampling_ratio_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", data->oversampling);
+}
+
+static ssize_t oversampling_ratio_store(struct device *dev,
+			struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+	unsigned int ratio;
+	int ret;
+
+	ret = kstrtouint(buf, 10, &ratio);
+	if (ret < 0)
+		return ret;
+	if (ratio < 1 || ratio > SI7006_MAX_OVERSAMPLING)
+		return -EINVAL;
+
+	mutex_lock(&data->update_lock);
+	data->oversampling = ratio;
+	mutex_unlock(&data->update_lock);
+
+	return count;
+}
+
+static ssize_t sample_interval_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", data->sample_interval);
+}
+
+static ssize_t sample_interval_store(struct device *dev,
+			struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+	unsigned int interval;
+	int ret;
+
+	ret = kstrtouint(buf, 10, &interval);
+	if (ret < 0)
+		return ret;
+	if (interval && (interval < SI7006_MIN_SAMPLE_INTERVAL_MS ||
+			interval > SI7006_MAX_SAMPLE_INTERVAL_MS))
+		return -EINVAL;
+
+	mutex_lock(&data->update_lock);
+	data->sample_interval = interval;
+	data->cur_interval = clamp_val(interval, data->interval_min,
+				data->interval_max);
+	if (interval)
+		si7006_sampler_queue(data, 0);
+	mutex_unlock(&data->update_lock);
+
+	return count;
+}
+
+static const char * const si7006_policy_names[] = {
+	[SI7006_POLICY_FIXED] = "fixed",
+	[SI7006_POLICY_ADAPTIVE] = "adaptive",
+};
+
+static ssize_t sample_policy_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%s\n", si7006_policy_names[data->sample_policy]);
+}
+
+static ssize_t sample_policy_store(struct device *dev,
+			struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+	int policy;
+
+	policy = sysfs_match_string(si7006_policy_names, buf);
+	if (policy < 0)
+		return policy;
+
+	mutex_lock(&data->update_lock);
+	data->sample_policy = policy;
+	mutex_unlock(&data->update_lock);
+
+	return count;
+}
+
+static ssize_t sample_interval_current_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", data->sample_interval ?
+				data->cur_interval : 0);
+}
+
+static ssize_t sample_interval_min_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", data->interval_min);
+}
+
+static ssize_t sample_interval_min_store(struct device *dev,
+			struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+	unsigned int interval;
+	int ret;
+
+	ret = kstrtouint(buf, 10, &interval);
+	if (ret < 0)
+		return ret;
+	if (interval < SI7006_MIN_SAMPLE_INTERVAL_MS ||
+			interval > SI7006_MAX_SAMPLE_INTERVAL_MS)
+		return -EINVAL;
+
+	mutex_lock(&data->update_lock);
+	if (interval > data->interval_max) {
+		mutex_unlock(&data->update_lock);
+		return -EINVAL;
+	}
+	data->interval_min = interval;
+	mutex_unlock(&data->update_lock);
+
+	return count;
+}
+
+static ssize_t sample_interval_max_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", data->interval_max);
+}
+
+static ssize_t sample_interval_max_store(struct device *dev,
+			struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+	unsigned int interval;
+	int ret;
+
+	ret = kstrtouint(buf, 10, &interval);
+	if (ret < 0)
+		return ret;
+	if (interval > SI7006_MAX_SAMPLE_INTERVAL_MS)
+		return -EINVAL;
+
+	mutex_lock(&data->update_lock);
+	if (interval < data->interval_min) {
+		mutex_unlock(&data->update_lock);
+		return -EINVAL;
+	}
+	data->interval_max = interval;
+	mutex_unlock(&data->update_lock);
+
+	return count;
+}
+
+static ssize_t sample_threshold_temperature_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%ld\n", data->threshold_temperature);
+}
+
+static ssize_t sample_threshold_temperature_store(struct device *dev,
+			struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+	long threshold;
+	int ret;
+
+	ret = kstrtol(buf, 10, &threshold);
+	if (ret < 0)
+		return ret;
+	if (threshold < 0)
+		return -EINVAL;
+
+	mutex_lock(&data->update_lock);
+	data->threshold_temperature = threshold;
+	mutex_unlock(&data->update_lock);
+
+	return count;
+}
+
+static ssize_t sample_threshold_humidity_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%ld\n", data->threshold_humidity);
+}
+
+static ssize_t sample_threshold_humidity_store(struct device *dev,
+			struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+	long threshold;
+	int ret;
+
+	ret = kstrtol(buf, 10, &threshold);
+	if (ret < 0)
+		return ret;
+	if (threshold < 0)
+		return -EINVAL;
+
+	mutex_lock(&data->update_lock);
+	data->threshold_humidity = threshold;
+	mutex_unlock(&data->update_lock);
+
+	return count;
+}
+
+static ssize_t sample_age_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+	ktime_t timestamp;
+	unsigned int seq;
+	bool valid;
+
+	do {
+		seq = read_seqbegin(&data->sample_lock);
+		valid = data->sample_valid;
+		timestamp = data->sample.timestamp;
+	} while (read_seqretry(&data->sample_lock, seq));
+
+	if (!valid)
+		return -ENODATA;
+
+	return sprintf(buf, "%lld\n", ktime_ms_delta(ktime_get(), timestamp));
+}
+
+static ssize_t sample_timestamp_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+	ktime_t timestamp;
+	unsigned int seq;
+	bool valid;
+
+	do {
+		seq = read_seqbegin(&data->sample_lock);
+		valid = data->sample_valid;
+		timestamp = data->sample.timestamp;
+	} while (read_seqretry(&data->sample_lock, seq));
+
+	if (!valid)
+		return -ENODATA;
+
+	return sprintf(buf, "%lld\n", ktime_to_ns(timestamp));
+}
+
+static ssize_t sample_seq_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+	unsigned int seq;
+	u64 sample_seq;
+
+	do {
+		seq = read_seqbegin(&data->sample_lock);
+		sample_seq = data->sample.seq;
+	} while (read_seqretry(&data->sample_lock, seq));
+
+	return sprintf(buf, "%llu\n", sample_seq);
+}
+
+static ssize_t max_staleness_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", data->max_staleness);
+}
+
+static ssize_t max_staleness_store(struct device *dev,
+			struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+	unsigned int staleness;
+	int ret;
+
+	ret = kstrtouint(buf, 10, &staleness);
+	if (ret < 0)
+		return ret;
+
+	mutex_lock(&data->update_lock);
+	data->max_staleness = staleness;
+	mutex_unlock(&data->update_lock);
+
+	return count;
+}
+
+static ssize_t sample_group_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", READ_ONCE(data->group_sampling));
+}
+
+static ssize_t sample_group_store(struct device *dev,
+			struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+	bool enable;
+	int ret;
+
+	ret = kstrtobool(buf, &enable);
+	if (ret < 0)
+		return ret;
+	/* The group runs no hold master measures */
+	if (enable && data->xfer_method == SI7006_XFER_SMBUS)
+		return -EOPNOTSUPP;
+
+	mutex_lock(&data->update_lock);
+	WRITE_ONCE(data->group_sampling, enable);
+	/* Hand the sampling over between the sensor and its adapter group */
+	si7006_sampler_queue(data, 0);
+	mutex_unlock(&data->update_lock);
+
+	return count;
+}
+
+static ssize_t sample_contract_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", READ_ONCE(data->contract_age));
+}
+
+static ssize_t stale_while_revalidate_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", data->swr_max_age);
+}
+
+static ssize_t stale_while_revalidate_store(struct device *dev,
+			struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+	unsigned int max_age;
+	int ret;
+
+	ret = kstrtouint(buf, 10, &max_age);
+	if (ret < 0)
+		return ret;
+
+	WRITE_ONCE(data->swr_max_age, max_age);
+
+	return count;
+}
+
+static ssize_t error_count_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%lu\n", data->error_count);
+}
+
+static ssize_t reset_count_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%lu\n", data->reset_count);
+}
+
+static ssize_t chip_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%s\n", data->variant->name);
+}
+
+static ssize_t resolution_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+	const struct si7006_variant *variant = data->variant;
+	unsigned int res = data->resolution;
+
+	return sprintf(buf, "%u %u\n", variant->rh_bits[res],
+				variant->temp_bits[res]);
+}
+
+static ssize_t resolution_store(struct device *dev,
+			struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+	unsigned int res;
+	u8 bits;
+	int ret;
+
+	/* Selected by the humidity resolution, the temperature one follows */
+	ret = kstrtou8(buf, 10, &bits);
+	if (ret < 0)
+		return ret;
+
+	for (res = 0; res < SI7006_NUM_RESOLUTIONS; res++)
+		if (data->variant->rh_bits[res] == bits)
+			break;
+	if (res == SI7006_NUM_RESOLUTIONS)
+		return -EINVAL;
+
+	mutex_lock(&data->update_lock);
+	ret = si7006_reg_update(data, SI7006_REG_USER,
+				SI7006_USER_RES1 | SI7006_USER_RES0,
+				si7006_resolution_to_reg(res));
+	if (ret == 0)
+		data->resolution = res;
+	mutex_unlock(&data->update_lock);
+
+	return ret < 0 ? ret : count;
+}
+
+static const char * const si7006_bus_mode_names[] = {
+	[SI7006_BUS_STRETCH] = "stretch",
+	[SI7006_BUS_LOCK] = "lock",
+	[SI7006_BUS_RELEASE] = "release",
+};
+
+static ssize_t bus_mode_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%s\n", si7006_bus_mode_names[data->bus_mode]);
+}
+
+/**
+ * @brief Check whether the adapter can run a bus mode
+ * @param [in] data struct si7006_private pointer
+ * @param [in] mode SI7006_BUS_* mode
+ * @return true if the mode can be used
+ * @details The hold master measure stretches the clock; the no hold master
+ * one reads a result without a command, which SMBus can't do.
  */
-static long si7006_get_humidity_min(struct device *dev)
+static bool si7006_bus_mode_supported(struct si7006_private *data, int mode)
+{
+	if (mode == SI7006_BUS_STRETCH)
+		return !i2c_check_quirks(data->client->adapter,
+					I2C_AQ_NO_CLK_STRETCH);
+
+	return data->xfer_method != SI7006_XFER_SMBUS;
+}
+
+static ssize_t bus_mode_store(struct device *dev,
+			struct device_attribute *attr, const char *buf, size_t count)
 {
 	struct si7006_private *data = dev_get_drvdata(dev);
+	int mode;
 
-	return data->min_humidity;
+	mode = sysfs_match_string(si7006_bus_mode_names, buf);
+	if (mode < 0)
+		return mode;
+	if (!si7006_bus_mode_supported(data, mode))
+		return -EOPNOTSUPP;
+
+	mutex_lock(&data->update_lock);
+	data->bus_mode = mode;
+	mutex_unlock(&data->update_lock);
+
+	return count;
 }
 
-/**
- * @brief HWMON temperature read method
- * @param [in] dev struct device pointer
- * @param [in] attr attribute
- * @param [in] channel
- * @param [out] val pointer
- * @return 0 if success
- * @details Select what temperature is requested (current/max/min)
- * and return it.
- */
-static int si7006_read_temperature(struct device *dev, u32 attr,
-			int channel, long *val)
+static const char * const si7006_xfer_method_names[] = {
+	[SI7006_XFER_COMBINED] = "i2c",
+	[SI7006_XFER_SPLIT] = "split",
+	[SI7006_XFER_SMBUS] = "smbus",
+};
+
+static ssize_t transfer_method_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
 {
-	switch (attr) {
-		case hwmon_temp_input:
-			if (channel < SI7006_NUM_CH_TEMP)
-				*val = si7006_get_temperature(dev);
-			else
-				return -EOPNOTSUPP;
-			return 0;
-		case hwmon_temp_max:
-				if (channel < SI7006_NUM_CH_TEMP)
-					*val = si7006_get_temperature_max(dev);
-				else
-					return -EOPNOTSUPP;
-				return 0;
-		case hwmon_temp_min:
-				if (channel < SI7006_NUM_CH_TEMP)
-					*val = si7006_get_temperature_min(dev);
-				else
-					return -EOPNOTSUPP;
-				return 0;
-		default:
-			return -EOPNOTSUPP;
-	}
+	struct si7006_private *data = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%s\n",
+			si7006_xfer_method_names[data->xfer_method]);
 }
 
-/**
- * @brief HWMON humidity read method
- * @param [in] dev struct device pointer
- * @param [in] attr attribute
- * @param [in] channel
- * @param [out] val pointer
- * @return 0 if success
- * @details Select what humidity is requested (current/max/min)
- * and return it.
- */
-static int si7006_read_humidity(struct device *dev, u32 attr,
-			int channel, long *val)
+static ssize_t bus_stats_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
 {
-	switch (attr) {
-		case hwmon_humidity_input:
-			if (channel < SI7006_NUM_CH_TEMP)
-				*val = si7006_get_humidity(dev);
-			else
-				return -EOPNOTSUPP;
-			return 0;
-		case hwmon_humidity_max:
-				if (channel < SI7006_NUM_CH_TEMP)
-					*val = si7006_get_humidity_max(dev);
-				else
-					return -EOPNOTSUPP;
-				return 0;
-		case hwmon_humidity_min:
-				if (channel < SI7006_NUM_CH_TEMP)
-					*val = si7006_get_humidity_min(dev);
-				else
-					return -EOPNOTSUPP;
-				return 0;
-		default:
-			return -EOPNOTSUPP;
+	struct si7006_private *data = dev_get_drvdata(dev);
+	struct si7006_bus_stats *stats;
+	ssize_t len = 0;
+	int mode;
+	int ret;
+
+	ret = mutex_lock_killable(&data->update_lock);
+	if (ret)
+		return ret;
+	for (mode = 0; mode < SI7006_BUS_MODES; mode++) {
+		stats = &data->bus_stats[mode];
+		len += sprintf(buf + len,
+			"%s conversions=%lu errors=%lu polls=%lu occupancy_us=%llu "
+			"latency_us=%llu max_latency_us=%llu\n",
+			si7006_bus_mode_names[mode], stats->conversions,
+			stats->errors, stats->polls,
+			div_u64(stats->occupancy_ns, NSEC_PER_USEC),
+			div_u64(stats->latency_ns, NSEC_PER_USEC),
+			div_u64(stats->max_latency_ns, NSEC_PER_USEC));
 	}
+	mutex_unlock(&data->update_lock);
+
+	return len;
 }
 
-/* HWMON input read ops */
-/**
- * @brief HWMON Si7006 read method
- * @param [in] dev struct device pointer
- * @param [in] type struct hwmon_sensor_types pointer
- * @param [in] attr attribute
- * @param [in] channel
- * @param [out] val pointer
- * @return 0 if success
- * @details Select between temperature and humidity and run the measure.
- */
-static int si7006_read(struct device *dev, enum hwmon_sensor_types type,
-			u32 attr, int channel, long *val)
+static ssize_t read_stats_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
 {
-	switch (type) {
-		case hwmon_temp:
-			return si7006_read_temperature(dev, attr, channel, val);
-		case hwmon_humidity:
-			return si7006_read_humidity(dev, attr, channel, val);
-		default:
-			return -EOPNOTSUPP;
-	}
+	struct si7006_private *data = dev_get_drvdata(dev);
+	struct si7006_flight *flights[] = {
+		&data->hwmon_flight, &data->contract_flight,
+	};
+	static const char * const names[] = { "hwmon", "contract" };
+	ssize_t len = 0;
+	int i;
+
+	spin_lock(&data->flight_lock);
+	for (i = 0; i < ARRAY_SIZE(flights); i++)
+		len += sprintf(buf + len,
+			"%s refreshes=%lu coalesced=%lu timeouts=%lu\n",
+			names[i], flights[i]->refreshes, flights[i]->coalesced,
+			flights[i]->timeouts);
+	spin_unlock(&data->flight_lock);
+
+	return len;
 }
 
-/**
- * @brief HWMON function return channel name
- * @param [in] dev struct device pointer
- * @param [in] type enum hwmon_sensor_types
- * @param [in] attr attribute
- * @param [in] channel
- * @param [out] str string pointer
- * @return 0 if success.
- * @details Return the label of channel.
- */
-static int si7006_read_string(struct device *dev, enum hwmon_sensor_types type,
-		       u32 attr, int channel, const char **str)
+static ssize_t sampler_stats_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
 {
-	switch (type) {
-		case hwmon_temp:
-			*str = "BOARD TEMP";
-			return 0;
-		case hwmon_humidity:
-			*str = "BOARD HR";
-			return 0;
-		default:
-			return -EOPNOTSUPP;
-	}
-	return -EOPNOTSUPP;
+	struct si7006_private *data = dev_get_drvdata(dev);
+	struct si7006_sampler_stats *stats = &data->sampler_stats;
+	ssize_t len;
+	int ret;
+
+	ret = mutex_lock_killable(&data->update_lock);
+	if (ret)
+		return ret;
+	len = sprintf(buf, "runs=%lu late_us=%llu max_late_us=%llu cpu=%d\n",
+			stats->runs, div_u64(stats->late_ns, NSEC_PER_USEC),
+			div_u64(stats->max_late_ns, NSEC_PER_USEC),
+			stats->runs ? stats->cpu : -1);
+	mutex_unlock(&data->update_lock);
+
+	return len;
 }
 
-/**
- * @brief HWMON function return access attribute
- * @param [in] data unused
- * @param [in] type enum hwmon_sensor_types
- * @param [in] attr attribute
- * @param [in] channel
- * @return permission.
- * @details Returns file access permission
- */
-static umode_t si7006_is_visible(const void *data, enum hwmon_sensor_types type,
-			u32 attr, int channel)
+static DEVICE_ATTR_RO(chip);
+static DEVICE_ATTR_RW(resolution);
+static DEVICE_ATTR_RW(heater_enable);
+static DEVICE_ATTR_RW(heater_level);
+static DEVICE_ATTR_RO(heater_current);
+static DEVICE_ATTR_RO(heater_busy);
+static DEVICE_ATTR_RW(heater_pulse_period);
+static DEVICE_ATTR_RW(heater_pulse_duration);
+static DEVICE_ATTR_RO(snapshot);
+static DEVICE_ATTR_RO(absolute_humidity);
+static DEVICE_ATTR_RO(vapour_pressure_deficit);
+static DEVICE_ATTR_RO(temperature_spread);
+static DEVICE_ATTR_RO(humidity_spread);
+static DEVICE_ATTR_RW(oversampling_ratio);
+static DEVICE_ATTR_RW(sample_interval);
+static DEVICE_ATTR_RW(sample_policy);
+static DEVICE_ATTR_RO(sample_interval_current);
+static DEVICE_ATTR_RW(sample_interval_min);
+static DEVICE_ATTR_RW(sample_interval_max);
+static DEVICE_ATTR_RW(sample_threshold_temperature);
+static DEVICE_ATTR_RW(sample_threshold_humidity);
+static DEVICE_ATTR_RO(sample_age);
+static DEVICE_ATTR_RO(sample_timestamp);
+static DEVICE_ATTR_RO(sample_seq);
+static DEVICE_ATTR_RW(max_staleness);
+static DEVICE_ATTR_RW(sample_group);
+static DEVICE_ATTR_RO(sampler_stats);
+static DEVICE_ATTR_RO(read_stats);
+static DEVICE_ATTR_RO(sample_contract);
+static DEVICE_ATTR_RW(stale_while_revalidate);
+static DEVICE_ATTR_RO(error_count);
+static DEVICE_ATTR_RO(reset_count);
+static DEVICE_ATTR_RW(bus_mode);
+static DEVICE_ATTR_RO(bus_stats);
+static DEVICE_ATTR_RO(transfer_method);
+
+static struct attribute *si7006_attrs[] = {
+	&dev_attr_chip.attr,
+	&dev_attr_resolution.attr,
+	&dev_attr_heater_enable.attr,
+	&dev_attr_heater_level.attr,
+	&dev_attr_heater_current.attr,
+	&dev_attr_heater_busy.attr,
+	&dev_attr_heater_pulse_period.attr,
+	&dev_attr_heater_pulse_duration.attr,
+	&dev_attr_snapshot.attr,
+	&dev_attr_absolute_humidity.attr,
+	&dev_attr_vapour_pressure_deficit.attr,
+	&dev_attr_temperature_spread.attr,
+	&dev_attr_humidity_spread.attr,
+	&dev_attr_oversampling_ratio.attr,
+	&dev_attr_sample_interval.attr,
+	&dev_attr_sample_policy.attr,
+	&dev_attr_sample_interval_current.attr,
+	&dev_attr_sample_interval_min.attr,
+	&dev_attr_sample_interval_max.attr,
+	&dev_attr_sample_threshold_temperature.attr,
+	&dev_attr_sample_threshold_humidity.attr,
+	&dev_attr_sample_age.attr,
+	&dev_attr_sample_timestamp.attr,
+	&dev_attr_sample_seq.attr,
+	&dev_attr_max_staleness.attr,
+	&dev_attr_sample_group.attr,
+	&dev_attr_sampler_stats.attr,
+	&dev_attr_read_stats.attr,
+	&dev_attr_sample_contract.attr,
+	&dev_attr_stale_while_revalidate.attr,
+	&dev_attr_error_count.attr,
+	&dev_attr_reset_count.attr,
+	&dev_attr_bus_mode.attr,
+	&dev_attr_bus_stats.attr,
+	&dev_attr_transfer_method.attr,
+	NULL
+};
+
+static umode_t si7006_attr_is_visible(struct kobject *kobj,
+			struct attribute *attr, int index)
 {
-	switch (type) {
-		case hwmon_temp:
-			switch (attr) {
-				case hwmon_temp_input:
-				case hwmon_temp_max:
-				case hwmon_temp_min:
-					return S_IRUGO;
-				default:
-					break;
-			}
-			break;
-		case hwmon_humidity:
-			switch (attr) {
-				case hwmon_humidity_input:
-				case hwmon_humidity_max:
-				case hwmon_humidity_min:
-					return S_IRUGO;
-				default:
-					break;
-			}
-			break;
-		default:
-			break;
-	}
-	return 0;
+	struct si7006_private *data = dev_get_drvdata(kobj_to_dev(kobj));
+
+	/* Heater level only on the variants with a heater control register */
+	if ((attr == &dev_attr_heater_level.attr ||
+			attr == &dev_attr_heater_current.attr) &&
+			!data->variant->has_heater_level)
+		return 0;
+
+	return attr->mode;
 }
 
+static const struct attribute_group si7006_group = {
+	.attrs = si7006_attrs,
+	.is_visible = si7006_attr_is_visible,
+};
+__ATTRIBUTE_GROUPS(si7006);
+
 /****************************************************************************
  * HWMON STRUCTURES
  ****************************************************************************/
 
+/* Temperature channels are thermal zone sensors 0 and 1 in device tree */
+static const u32 si7006_chip_config[] = {
+	(HWMON_C_REGISTER_TZ|HWMON_C_UPDATE_INTERVAL),
+	0
+};
+
+static const struct hwmon_channel_info si7006_chip = {
+	.type = hwmon_chip,
+	.config = si7006_chip_config,
+};
+
 static const u32 si7006_temperature_config[] = {
-	(HWMON_T_INPUT|HWMON_T_LABEL|HWMON_T_MAX|HWMON_T_MIN),
+	(HWMON_T_INPUT|HWMON_T_LABEL|HWMON_T_MAX|HWMON_T_MIN|HWMON_T_FAULT),
+	(HWMON_T_INPUT|HWMON_T_LABEL),
 	0
 };
 
@@ -430,7 +3097,7 @@ static const struct hwmon_channel_info si7006_temperature = {
 };
 
 static const u32 si7006_humidity_config[] = {
-	(HWMON_H_INPUT|HWMON_H_LABEL|HWMON_H_MAX|HWMON_H_MIN),
+	(HWMON_H_INPUT|HWMON_H_LABEL|HWMON_H_MAX|HWMON_H_MIN|HWMON_H_FAULT),
 	0
 };
 
@@ -440,6 +3107,7 @@ static const struct hwmon_channel_info si7006_humidity = {
 };
 
 static const struct hwmon_channel_info *si7006_info[] = {
+	&si7006_chip,
 	&si7006_temperature,
 	&si7006_humidity,
 	NULL
@@ -448,7 +3116,8 @@ static const struct hwmon_channel_info *si7006_info[] = {
 static const struct hwmon_ops si7006_hwmon_ops = {
 	.is_visible = si7006_is_visible,
 	.read_string = si7006_read_string,
-	.read = si7006_read
+	.read = si7006_read,
+	.write = si7006_write
 };
 
 static const struct hwmon_chip_info si7006_chip_info = {
@@ -460,31 +3129,55 @@ static const struct hwmon_chip_info si7006_chip_info = {
  * PROBE SUPPORT FUNCTIONS
  ****************************************************************************/
 
-static int si7006_get_device_id(struct i2c_client *client, int *id)
+/**
+ * @brief Look up a variant by its electronic ID
+ * @param [in] id first byte of the electronic ID
+ * @return variant descriptor, NULL if unknown
+ */
+static const struct si7006_variant *si7006_find_variant(int id)
 {
-	char buf[6];
-	int  error;
+	int i;
 
-	/* Put the 2-byte command into the buffer */
-	buf[0] = 0xFC;
-	buf[1] = 0xC9;
+	for (i = 0; i < ARRAY_SIZE(si7006_variants); i++)
+		if (si7006_variants[i].id && si7006_variants[i].id == id)
+			return &si7006_variants[i];
 
-	/* Send the command */
-	error = i2c_master_send(client, buf, 2);
-	if (error < 0)
-	       return error;
+	return NULL;
+}
 
-	/* Receive the 6-byte result */
-	error = i2c_master_recv(client, buf, 6);
+/**
+ * @brief Read the device ID
+ * @param [in] data struct si7006_private pointer
+ * @param [out] id first byte of the second part of the electronic ID
+ * @return 0 if success
+ * @details Only the first byte of the ID is needed, which an SMBus only
+ * controller can read too.
+ */
+static int si7006_get_device_id(struct si7006_private *data, int *id)
+{
+	u8 cmd[2] = { SI7006_READ_ID_HIGH_0, SI7006_READ_ID_HIGH_1 };
+	u8 val;
+	int  error;
+
+	error = si7006_xfer(data, cmd, 2, &val, 1);
 	if (error < 0)
 		return error;
 
 	/* Return the device ID */
-	*id = buf[0];
+	*id = val;
 
 	return 0;  /* Success */
 }
 
+/**
+ * @brief Destroy the workqueue of a sensor
+ * @param [in] arg struct workqueue_struct pointer
+ */
+static void si7006_destroy_wq(void *arg)
+{
+	destroy_workqueue(arg);
+}
+
 /****************************************************************************
  * Si7006 PROBE
  ****************************************************************************/
@@ -493,8 +3186,11 @@ static int si7006_probe(struct i2c_client *client,
 {
 	struct device *dev = &client->dev;
 	struct si7006_private *data;
+	const struct si7006_variant *variant;
 	struct device *hwmon_dev;
 	int chip_id=0;
+	u8 reg;
+	int ret;
 
 	data = devm_kzalloc(dev, sizeof(struct si7006_private),GFP_KERNEL);
 	if (!data)
@@ -503,23 +3199,128 @@ static int si7006_probe(struct i2c_client *client,
 	dev_set_drvdata(dev, data);
 
 	mutex_init(&data->update_lock);
+	seqlock_init(&data->sample_lock);
 
-	/* Verify that we have a si7006 */
-	si7006_get_device_id(client,&chip_id);
-	if (chip_id!=ID_SI7006) {
-		dev_err(dev, "Si7006 not found");
-		return -ENXIO;
-	}
+	variant = device_get_match_data(dev);
+	if (!variant && id)
+		variant = &si7006_variants[id->driver_data];
+	if (!variant)
+		return -ENODEV;
 
 	data->client = client;
 
+	ret = si7006_select_xfer(client->adapter);
+	if (ret < 0) {
+		dev_err(dev, "adapter supports neither I2C nor stretched SMBus word data");
+		return ret;
+	}
+	data->xfer_method = ret;
+
+	/* Verify the variant, the Si70xx can be told apart by their ID */
+	if (variant->id) {
+		ret = si7006_get_device_id(data, &chip_id);
+		if (ret < 0) {
+			dev_err(dev, "%s ID read failed (%d)", variant->name,
+						ret);
+			return ret;
+		}
+		if (chip_id != variant->id) {
+			const struct si7006_variant *found;
+
+			found = si7006_find_variant(chip_id);
+			if (!found) {
+				dev_err(dev, "%s not found (ID 0x%02x)",
+						variant->name, chip_id);
+				return -ENXIO;
+			}
+			dev_info(dev, "%s found instead of %s", found->name,
+						variant->name);
+			variant = found;
+		}
+	}
+
+	data->variant = variant;
+
+	ret = si7006_debugfs_register(data);
+	if (ret)
+		return ret;
+
+	/* Read back the configuration left by a previous user */
+	ret = si7006_reg_read(data, SI7006_REG_USER, &reg);
+	if (ret < 0)
+		return ret;
+	data->heater_enabled = reg & SI7006_USER_HTRE;
+	data->resolution = si7006_reg_to_resolution(reg);
+
+	if (variant->has_heater_level) {
+		ret = si7006_reg_read(data, SI7006_REG_HEATER, &reg);
+		if (ret < 0)
+			return ret;
+		data->heater_level = reg & SI7006_HEATER_MASK;
+	}
+
+	/* Destroyed last, after the workers have been stopped */
+	data->wq = alloc_workqueue("si7006-%s",
+			WQ_UNBOUND | WQ_FREEZABLE | WQ_SYSFS, 0, dev_name(dev));
+	if (!data->wq)
+		return -ENOMEM;
+	ret = devm_add_action_or_reset(dev, si7006_destroy_wq, data->wq);
+	if (ret)
+		return ret;
+
+	INIT_DELAYED_WORK(&data->heater_work, si7006_heater_work);
+	ret = devm_add_action_or_reset(dev, si7006_heater_stop, data);
+	if (ret)
+		return ret;
+
+	data->update_interval = SI7006_UPDATE_INTERVAL_MS;
+	data->backoff_ms = SI7006_BACKOFF_MIN_MS;
+	/* SMBus can't read a result without a command: hold master only */
+	if (data->xfer_method == SI7006_XFER_SMBUS)
+		data->bus_mode = SI7006_BUS_STRETCH;
+	else
+		data->bus_mode = SI7006_BUS_RELEASE;
+	data->oversampling = 1;
+	data->sample_policy = SI7006_POLICY_FIXED;
+	data->interval_min = SI7006_MIN_SAMPLE_INTERVAL_MS;
+	data->interval_max = SI7006_MAX_SAMPLE_INTERVAL_MS;
+	data->threshold_temperature = SI7006_THRESHOLD_TEMPERATURE;
+	data->threshold_humidity = SI7006_THRESHOLD_HUMIDITY;
+	INIT_DEFERRABLE_WORK(&data->sample_work, si7006_sample_work);
+	data->hwmon_flight.data = data;
+	INIT_WORK(&data->hwmon_flight.work, si7006_flight_work);
+	data->contract_flight.data = data;
+	INIT_WORK(&data->contract_flight.work, si7006_flight_work);
+	spin_lock_init(&data->flight_lock);
+	init_waitqueue_head(&data->flight_wq);
+	ret = devm_add_action_or_reset(dev, si7006_sampler_stop, data);
+	if (ret)
+		return ret;
+
+	ret = si7006_group_join(data);
+	if (ret)
+		return ret;
+
+	/* Unregistered first: files can't set contracts on a stopped sampler */
+	ret = si7006_chardev_register(data);
+	if (ret)
+		return ret;
+
 	hwmon_dev = devm_hwmon_device_register_with_info(dev, client->name,
-							 data, &si7006_chip_info, NULL);
+							 data, &si7006_chip_info, si7006_groups);
 
 	if (IS_ERR(hwmon_dev))
 		return PTR_ERR(hwmon_dev);
 
-	dev_info(dev, "%s: sensor '%s'\n", dev_name(hwmon_dev), client->name);
+	data->hwmon_dev = hwmon_dev;
+
+	ret = si7006_aggregate_add(data);
+	if (ret)
+		return ret;
+
+	dev_info(dev, "%s: sensor '%s' (%s, %s transfers)\n", dev_name(hwmon_dev),
+				client->name, variant->name,
+				si7006_xfer_method_names[data->xfer_method]);
 
 	return 0;
 }
@@ -535,16 +3336,77 @@ static int si7006_remove(struct i2c_client *client)
 	return 0;
 }
 
+/**
+ * @brief Resume method
+ * @param [in] dev struct device pointer
+ * @return 0 if success
+ * @details The sensor may have been powered off while suspended: the cached
+ * configuration is written back.
+ */
+static int __maybe_unused si7006_resume(struct device *dev)
+{
+	struct si7006_private *data = dev_get_drvdata(dev);
+	int ret;
+
+	mutex_lock(&data->update_lock);
+	ret = si7006_reg_restore(data);
+	mutex_unlock(&data->update_lock);
+
+	return ret;
+}
+
+static SIMPLE_DEV_PM_OPS(si7006_pm_ops, NULL, si7006_resume);
+
 static struct i2c_driver si7006_i2c_driver = {
 		.class		= I2C_CLASS_HWMON,
 		.driver = {
 			.name = "si7006",
+			.of_match_table = si7006_of_match,
+			.pm = &si7006_pm_ops,
 		},
 		.probe    = si7006_i2c_probe,
 		.remove	  = si7006_remove,
 		.id_table = si7006_id,
 };
-module_i2c_driver(si7006_i2c_driver);
+
+static int __init si7006_init(void)
+{
+	int ret;
+
+	si7006_debugfs_init();
+
+	ret = si7006_netlink_init();
+	if (ret)
+		goto err_debugfs;
+
+	ret = si7006_aggregate_init();
+	if (ret)
+		goto err_netlink;
+
+	ret = i2c_add_driver(&si7006_i2c_driver);
+	if (ret)
+		goto err_aggregate;
+
+	return 0;
+
+err_aggregate:
+	si7006_aggregate_exit();
+err_netlink:
+	si7006_netlink_exit();
+err_debugfs:
+	si7006_debugfs_exit();
+	return ret;
+}
+module_init(si7006_init);
+
+static void __exit si7006_exit(void)
+{
+	i2c_del_driver(&si7006_i2c_driver);
+	si7006_aggregate_exit();
+	si7006_netlink_exit();
+	si7006_debugfs_exit();
+}
+module_exit(si7006_exit);
 
 MODULE_DESCRIPTION("HWMON Si7006 driver");
 MODULE_AUTHOR("Massimiliano Negretti <massimiliano.negretti@open-eyes.it>");
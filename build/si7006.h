@@ -27,7 +27,15 @@
 
 #define SI7006_NUM_REGS                                 256
 #define ID_SI7006			                                  0x06
-#define SI7006_NUM_CH_TEMP                              1
+#define ID_SI7013                                       0x0D
+#define ID_SI7020                                       0x14
+#define ID_SI7021                                       0x15
+#define SI7006_NUM_CH_TEMP                              2
+#define SI7006_NUM_CH_HUMIDITY                          1
+
+/* Temperature channels */
+#define SI7006_CH_BOARD                                 0
+#define SI7006_CH_DEW_POINT                             1
 
 /* Si7006 register addresses */
 #define SI7006_MEAS_REL_HUMIDITY_MASTER_MODE            0xE5
@@ -47,21 +55,319 @@
 #define SI7006_FIRMWARE_0                               0x84
 #define SI7006_FIRMWARE_1                               0xB8
 
+/* User register 1 bits */
+#define SI7006_USER_RES1                                0x80
+#define SI7006_USER_VDDS                                0x40
+#define SI7006_USER_HTRE                                0x04
+#define SI7006_USER_RES0                                0x01
+
+/* Status bits of a measure result */
+#define SI7006_STATUS_MASK                              0x03
+
+/* Heater control register */
+#define SI7006_HEATER_MASK                              0x0F
+#define SI7006_HEATER_MAX_LEVEL                         15
+/* Heater current in uA: 3.09mA at level 0, about 6.07mA per step */
+#define SI7006_HEATER_BASE_UA                           3090
+#define SI7006_HEATER_STEP_UA                           6074
+/* Time after heater switch-off during which samples are not trusted */
+#define SI7006_HEATER_SETTLE_MS                         30000
+/* Heater schedule: longest period in seconds, retry of a failed switch */
+#define SI7006_HEATER_MAX_PERIOD_S                      86400
+#define SI7006_HEATER_RETRY_MS                          1000
+
+/* Measure resolutions, indexed by the RES1:RES0 bits of user register 1 */
+#define SI7006_NUM_RESOLUTIONS                          4
+
+/* No hold master conversion */
+#define SI7006_CONV_SLACK_US                            100
+#define SI7006_NOHOLD_POLL_MIN_US                       100
+#define SI7006_NOHOLD_POLL_MAX_US                       2000
+#define SI7006_NOHOLD_RETRIES                           10
+
+/* Coordinated sampling: members due within the window join a round */
+#define SI7006_GROUP_WINDOW_MS                          100
+
+/* Relay channel buffer */
+#define SI7006_RELAY_SUBBUF_SIZE                        4096
+#define SI7006_RELAY_N_SUBBUFS                          64
+
+/* Records of the bus trace buffer */
+#define SI7006_TRACE_RECORDS                            16384
+
+/* Channels of the aggregate device */
+#define SI7006_AGG_MIN                                  0
+#define SI7006_AGG_MEAN                                 1
+#define SI7006_AGG_MAX                                  2
+
+/* Supported chip variants */
+enum si7006_chip {
+	SI7006,
+	SI7013,
+	SI7020,
+	SI7021,
+	HTU21,
+	SHT21,
+};
+
+/*
+ * Chip variant descriptor. All the variants share the measure, user
+ * register and reset commands, they differ in what follows.
+ */
+struct si7006_variant {
+	const char             *name;
+	u8                     id;             /* 0: no electronic ID */
+	bool                   has_old_temp;   /* read temperature command */
+	bool                   has_heater_level; /* heater control register */
+	u8                     rh_bits[SI7006_NUM_RESOLUTIONS];
+	u8                     temp_bits[SI7006_NUM_RESOLUTIONS];
+	/* Max conversion times in us */
+	u32                    rh_conv_us[SI7006_NUM_RESOLUTIONS];
+	u32                    temp_conv_us[SI7006_NUM_RESOLUTIONS];
+};
+
+/* Cached control registers */
+enum si7006_reg {
+	SI7006_REG_USER,
+	SI7006_REG_HEATER,
+	SI7006_NUM_CACHED_REGS,
+};
+
+struct si7006_reg_cache {
+	u8                     val;
+	bool                   valid;
+};
+
+/* Measure sequencing on the bus */
+enum si7006_bus_mode {
+	SI7006_BUS_STRETCH,
+	SI7006_BUS_LOCK,
+	SI7006_BUS_RELEASE,
+	SI7006_BUS_MODES,
+};
+
+/* Background sampler wakeups */
+struct si7006_sampler_stats {
+	unsigned long          runs;
+	u64                    late_ns;
+	u64                    max_late_ns;
+	int                    cpu;
+};
+
+/* Transfer methods of the adapter, fastest first */
+enum si7006_xfer_method {
+	SI7006_XFER_COMBINED,
+	SI7006_XFER_SPLIT,
+	SI7006_XFER_SMBUS,
+};
+
+struct si7006_bus_stats {
+	unsigned long          conversions;
+	unsigned long          errors;
+	unsigned long          polls;
+	u64                    occupancy_ns;
+	u64                    latency_ns;
+	u64                    max_latency_ns;
+};
+
+/* Freshness window of the cached sample */
+#define SI7006_UPDATE_INTERVAL_MS                       1000
+#define SI7006_MIN_UPDATE_INTERVAL_MS                   1
+#define SI7006_MAX_UPDATE_INTERVAL_MS                   60000
+
+/* Bounded wait of a reader for a refresh in flight */
+#define SI7006_READ_TIMEOUT_MS                          1000
+
+/* Error recovery */
+#define SI7006_RESET_MS                                 15
+#define SI7006_RESET_THRESHOLD                          3
+#define SI7006_BACKOFF_MIN_MS                           100
+#define SI7006_BACKOFF_MAX_MS                           60000
+
+/* Background sampler */
+#define SI7006_MAX_OVERSAMPLING                         16
+#define SI7006_MIN_SAMPLE_INTERVAL_MS                   100
+#define SI7006_MAX_SAMPLE_INTERVAL_MS                   60000
+/* Default change between samples that tightens the adaptive interval */
+#define SI7006_THRESHOLD_TEMPERATURE                    200
+#define SI7006_THRESHOLD_HUMIDITY                       1000
+
+enum si7006_sample_policy {
+	SI7006_POLICY_FIXED,
+	SI7006_POLICY_ADAPTIVE,
+};
+
+/* Q16 fixed point constants of the psychrometric functions */
+#define SI7006_FP_SHIFT                                 16
+#define SI7006_FP_ONE                                   (1LL << SI7006_FP_SHIFT)
+#define SI7006_FP_LN2                                   45426
+#define SI7006_FP_LOG2E                                 94548
+#define SI7006_MAGNUS_A                                 1154744LL
+#define SI7006_MAGNUS_B                                 15933112LL
+#define SI7006_MAGNUS_ES0                               40055603LL
+
+struct si7006_sample {
+	long                   temperature;    /* milli celsius */
+	long                   humidity;       /* milli %RH */
+	long                   dew_point;      /* milli celsius */
+	long                   abs_humidity;   /* mg/m3 */
+	long                   vpd;            /* Pa */
+	long                   temperature_spread;
+	long                   humidity_spread;
+	ktime_t                timestamp;      /* CLOCK_MONOTONIC */
+	u64                    seq;            /* 1 for the first sample */
+};
+
+struct si7006_private;
+
+/* Refresh run once for all the readers waiting for it */
+struct si7006_flight {
+	struct work_struct     work;
+	struct si7006_private  *data;
+	bool                   in_flight;
+	u64                    gen;            /* refreshes completed */
+	int                    ret;
+	unsigned int           max_age;        /* strictest contract, ms */
+	unsigned long          refreshes;
+	unsigned long          coalesced;
+	unsigned long          timeouts;
+};
+
+struct si7006_cdev;
+struct si7006_group;
+struct si7006_faults;
+struct si7006_trace;
+
 struct si7006_private {
 	struct i2c_client	     *client;
+	struct device          *hwmon_dev;
+	struct si7006_cdev     *cdev;
+	struct dentry          *debugfs;
+	struct si7006_faults   *faults;
+	struct si7006_trace    *trace;
+	struct rchan           *relay;         /* under update_lock */
+	u32                    relay_dropped;
+	u32                    relay_seq;
+	struct list_head       node;           /* aggregate instances */
+	const struct si7006_variant *variant;
+	struct workqueue_struct *wq;           /* unbound, cpumask in sysfs */
   struct mutex           update_lock;
+	/* Control registers, under update_lock */
+	struct si7006_reg_cache regs[SI7006_NUM_CACHED_REGS];
+	unsigned int           resolution;
+	/* Bus sequencing */
+	enum si7006_xfer_method xfer_method;
+	enum si7006_bus_mode   bus_mode;
+	bool                   bus_locked;
+	u64                    bus_busy_ns;
+	struct si7006_bus_stats bus_stats[SI7006_BUS_MODES];
+	/* Sample registers, written under update_lock and sample_lock */
+	seqlock_t              sample_lock;
+	bool                   sample_valid;
+	struct si7006_sample   sample;
+	unsigned int           update_interval;
+	unsigned int           contract_age;   /* strictest file contract */
+	unsigned int           max_staleness;
+	unsigned int           swr_max_age;
+	/* Refreshes in flight, shared by the readers, under flight_lock */
+	spinlock_t             flight_lock;
+	wait_queue_head_t      flight_wq;
+	struct si7006_flight   hwmon_flight;
+	struct si7006_flight   contract_flight;
+	/* Error recovery */
+	int                    last_error;
+	unsigned int           consecutive_errors;
+	unsigned int           backoff_ms;
+	unsigned long          backoff_until;
+	unsigned long          error_count;
+	unsigned long          reset_count;
+	bool                   fault;
 	/* Temperature registers */
-	bool                   temperature_valid;
 	long                   max_temperature;
-	long                   temperature;
 	long                   min_temperature;
-	unsigned long          temperature_updated;
 	/* Humidity registers */
-	bool                   humidity_valid;
 	long                   max_humidity;
-	long                   humidity;
 	long                   min_humidity;
-	unsigned long          humidity_updated;
+	/* Background sampler */
+	unsigned int           sample_interval;
+	unsigned int           oversampling;
+	enum si7006_sample_policy sample_policy;
+	unsigned int           cur_interval;
+	unsigned int           interval_min;
+	unsigned int           interval_max;
+	long                   threshold_temperature;
+	long                   threshold_humidity;
+	struct delayed_work    sample_work;
+	ktime_t                sample_due;
+	struct si7006_sampler_stats sampler_stats;
+	/* Coordinated sampling, the round state under group->lock */
+	struct si7006_group    *group;
+	struct list_head       group_node;
+	bool                   group_sampling;
+	ktime_t                group_due;
+	struct list_head       round_node;
+	int                    round_ret;
+	u16                    round_rh_code;
+	u16                    round_temp_code;
+	bool                   round_temp_pending;
+	/* Heater */
+	bool                   heater_enabled;
+	u8                     heater_level;
+	unsigned int           heater_period;
+	unsigned int           heater_duration;
+	bool                   heater_pulse_on;
+	unsigned long          heater_settled;
+	struct delayed_work    heater_work;
+};
+
+/* Sensors sharing a root I2C adapter */
+struct si7006_group {
+	struct i2c_adapter     *root;
+	struct list_head       node;
+	struct list_head       members;
+	struct mutex           lock;
+	struct workqueue_struct *wq;           /* unbound, cpumask in sysfs */
+	struct delayed_work    work;
 };
 
+/* si7006.c */
+u32 si7006_status_flags(struct si7006_private *data);
+void si7006_set_contract(struct si7006_private *data, unsigned int max_age);
+int si7006_read_fresh(struct si7006_private *data, unsigned int max_age,
+			struct si7006_sample *sample, u32 *flags);
+unsigned int si7006_group_round(struct si7006_group *group);
+
+/* si7006-group.c */
+int si7006_group_join(struct si7006_private *data);
+void si7006_group_kick(struct si7006_private *data);
+
+/* si7006-chardev.c */
+int si7006_chardev_register(struct si7006_private *data);
+void si7006_chardev_update(struct si7006_private *data);
+
+/* si7006-netlink.c */
+int si7006_netlink_init(void);
+void si7006_netlink_exit(void);
+void si7006_netlink_sample(struct si7006_private *data,
+			const struct si7006_sample *sample);
+void si7006_netlink_alarm(struct si7006_private *data, u32 alarm, bool active);
+
+/* si7006-aggregate.c */
+int si7006_aggregate_init(void);
+void si7006_aggregate_exit(void);
+int si7006_aggregate_add(struct si7006_private *data);
+
+/* si7006-debugfs.c */
+void si7006_debugfs_init(void);
+void si7006_debugfs_exit(void);
+int si7006_debugfs_register(struct si7006_private *data);
+int si7006_fault_inject(struct si7006_private *data);
+void si7006_fault_corrupt(struct si7006_private *data, u8 *buf, int len);
+bool si7006_trace_replaying(struct si7006_private *data);
+int si7006_trace_replay(struct si7006_private *data, u16 flags, u8 *buf,
+			int len);
+void si7006_trace_record(struct si7006_private *data, ktime_t start,
+			u16 flags, const u8 *buf, int len, int ret);
+void si7006_relay_log(struct si7006_private *data, u16 temp_code, u16 rh_code);
+
 #endif /* _SI7006_H */